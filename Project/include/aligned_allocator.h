@@ -0,0 +1,57 @@
+#ifndef ALIGNED_ALLOCATOR_H
+#define ALIGNED_ALLOCATOR_H
+
+#include <cstddef>
+#include <new>
+
+namespace detection {
+
+/**
+ * Allocator that places the first element on the given boundary,
+ * e.g. a cache line, so vector registers can load rows
+ * of the buffer without crossing lines.
+ */
+template <typename T, size_t Alignment>
+class AlignedAllocator {
+public:
+  static_assert(Alignment >= alignof(T), "Alignment is weaker than the type requires.");
+  static_assert((Alignment & (Alignment - 1)) == 0, "Alignment should be a power of two.");
+
+  typedef T value_type;
+
+  template <typename U>
+  struct rebind {
+    typedef AlignedAllocator<U, Alignment> other;
+  };
+
+  AlignedAllocator() = default;
+
+  template <typename U>
+  AlignedAllocator(const AlignedAllocator<U, Alignment>&) {
+      // empty on purpose
+  }
+
+  T* allocate(size_t size) {
+      return static_cast<T*>(::operator new(size * sizeof(T), std::align_val_t(Alignment)));
+  }
+
+  void deallocate(T* pointer, size_t) {
+      ::operator delete(pointer, std::align_val_t(Alignment));
+  }
+
+  template <typename U>
+  bool operator==(const AlignedAllocator<U, Alignment>&) const {
+      return true;
+  }
+
+  template <typename U>
+  bool operator!=(const AlignedAllocator<U, Alignment>&) const {
+      return false;
+  }
+
+  ~AlignedAllocator() = default;
+};
+
+} // namespace detection
+
+#endif //ALIGNED_ALLOCATOR_H
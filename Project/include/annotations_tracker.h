@@ -74,6 +74,11 @@ public:
      */
     FrameInfo describeFrame(uint32_t frame_id) const;
 
+    /**
+     * Ids of the annotated frames in the playback order.
+     */
+    std::vector<uint32_t> annotatedFrames() const;
+
     ~AnnotationsTracker() = default;
 };
 
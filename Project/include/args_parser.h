@@ -24,6 +24,8 @@ bool HasFlag(const ArgsDict& args, const std::string& arg);
 
 int GetInt(const ArgsDict& args, const std::string& arg, int default_val = -1);
 
+double GetDouble(const ArgsDict& args, const std::string& arg, double default_val);
+
 std::string GetString(const ArgsDict& args,
                       const std::string& arg);
 
@@ -0,0 +1,39 @@
+#ifndef DISTANCE_KERNELS_H
+#define DISTANCE_KERNELS_H
+
+#include <cstddef>
+
+namespace detection {
+
+/**
+ * Computes squared euclidean distances between the query
+ * and {@code count} rows, every next row starts {@code stride}
+ * floats after the previous one.
+ */
+struct SquaredDistancesKernel {
+public:
+  typedef void (*Function)(const float* query,
+                           const float* rows,
+                           size_t count,
+                           size_t dimensions,
+                           size_t stride,
+                           float* out_distances);
+
+  const char* name;
+  Function compute;
+};
+
+/**
+ * Returns the fastest kernel the processor supports:
+ * AVX-512, AVX2 or the portable scalar one.
+ * The choice is made once, on the first call.
+ *
+ * The vector kernels sum the terms in a different order,
+ * so their results may differ from the scalar ones
+ * in the last bits of the mantissa.
+ */
+const SquaredDistancesKernel& GetSquaredDistancesKernel();
+
+} // namespace detection
+
+#endif //DISTANCE_KERNELS_H
@@ -1,23 +1,81 @@
 #ifndef DLIB_FACE_DETECTION_MODEL_H
 #define DLIB_FACE_DETECTION_MODEL_H
 
+#include <memory>
+
 #include <dlib/image_processing/frontal_face_detector.h>
 
 #include "face_detection_model.h"
+#include "object_pool.h"
+
+namespace {
+
+// in pixels, frames larger than a tile and its overlap are split
+// into tiles searched in parallel, zero searches frames as a whole
+const uint32_t DEFAULT_DLIB_TILE_SIZE = 0;
+// in pixels, tiles overlap by the largest face they are trusted
+// with, larger faces are searched on the coarse pyramid levels
+const uint32_t DEFAULT_DLIB_TILE_OVERLAP = 160;
+
+} // namespace
 
 namespace detection {
 
+/**
+ * Dlib HOG face detector.
+ *
+ * With a positive tile size, large frames are searched in parallel:
+ * the finest pyramid levels, whose window is not larger than the tile
+ * overlap, run on overlapping tiles, and the other levels run on the
+ * frame downsampled by the detector's own pyramid, so every level is
+ * searched exactly once. A tile only keeps faces centred in its own
+ * part of the frame, those faces fit into the tile as a whole, so
+ * parts of faces cut by the tile border are dropped. Detections are
+ * merged with the non-maximum suppression of the detector itself,
+ * like in the serial search. HOG features close to the tile borders
+ * see less context, so faces there may be scored a bit differently
+ * than in the serial search, {@code --benchmark-detectors} compares both.
+ */
 class DLibFaceDetectionModel: public FaceDetectionModel {
 private:
     dlib::frontal_face_detector _detector;
+    uint32_t _tile_size;
+    uint32_t _tile_overlap;
+    // the finest pyramid levels, searched on tiles
+    uint32_t _tile_levels;
+
+    // the detector keeps its scanning state inside, so every
+    // thread leases its own copy limited to the tile levels
+    std::shared_ptr<ObjectPool<dlib::frontal_face_detector>> _tile_detectors;
+
+    /**
+     * With {@code should_downscale} the image is searched at the detection
+     * scale and faces are mapped back, otherwise at full resolution.
+     */
+    std::vector<Face> detect(const Rect& viewport, cv::Mat& raw_image, bool should_downscale);
+
+    /**
+     * Searches the image tile by tile on the shared thread pool,
+     * the coarse levels are searched at the same time.
+     */
+    std::vector<dlib::rectangle> detectTiled(const cv::Mat& image);
 
 public:
-    DLibFaceDetectionModel();
+    DLibFaceDetectionModel(uint32_t tile_size = DEFAULT_DLIB_TILE_SIZE,
+                           uint32_t tile_overlap = DEFAULT_DLIB_TILE_OVERLAP);
     DLibFaceDetectionModel(const DLibFaceDetectionModel& that);
     DLibFaceDetectionModel& operator=(const DLibFaceDetectionModel& that);
 
     std::vector<Face> extractFaces(const Rect& viewport, cv::Mat& image) override;
 
+    /**
+     * Runs the detector on every region separately and
+     * drops faces far off the size of the predicted one.
+     */
+    std::vector<Face> extractFaces(const Rect& viewport,
+                                   cv::Mat& image,
+                                   const std::vector<Rect>& rois) override;
+
     ~DLibFaceDetectionModel() = default;
 };    
     
@@ -2,36 +2,43 @@
 #define DLIB_UTILS_H
 
 #include <cstdint>
+#include <stdexcept>
 
 #include <dlib/image_io.h>
+#include <dlib/opencv.h>
 #include <opencv2/opencv.hpp>
 
 namespace detection {
 
-static dlib::array2d<dlib::rgb_pixel> AsRGBOpenCVMatrix(const cv::Mat& mat) {
-    cv::Mat clone = mat.clone();
-
-    // we need to convert grey images back
-    // to rgb
-    if (mat.channels() == 1) {
-        cv::cvtColor(clone, clone, cv::COLOR_GRAY2BGR);
+/**
+ * Wraps the given matrix into dlib's image view without
+ * copying pixels: dlib reads straight from the BGR memory
+ * of the matrix and swaps channels when it needs RGB.
+ *
+ * Greyscale matrices are expanded to BGR into {@code buffer},
+ * the buffer keeps its memory between calls as long as
+ * the size of images does not change.
+ *
+ * The view is valid until {@code mat} or {@code buffer} are changed.
+ */
+static dlib::cv_image<dlib::bgr_pixel> AsDlibImage(const cv::Mat& mat, cv::Mat& buffer) {
+    if (mat.depth() != CV_8U) {
+        throw std::runtime_error("Only 8-bit images can be passed to dlib");
     }
 
-    dlib::array2d<dlib::rgb_pixel> dlib_mat(clone.rows, clone.cols);
-
-    for (size_t i = 0; i < clone.rows; i++) {
-        for (size_t j = 0; j < clone.cols; j++) {
-            cv::Vec3b color_vector = clone.at<cv::Vec3b>(i, j);
-
-            unsigned char b = static_cast<unsigned char>(color_vector[0]);
-            unsigned char g = static_cast<unsigned char>(color_vector[1]);
-            unsigned char r = static_cast<unsigned char>(color_vector[2]);
+    if (mat.channels() == 3) {
+        return dlib::cv_image<dlib::bgr_pixel>(mat);
+    }
 
-            dlib_mat[i][j] = dlib::rgb_pixel(r, g, b);
-        }
+    if (mat.channels() == 1) {
+        cv::cvtColor(mat, buffer, cv::COLOR_GRAY2BGR);
+    } else if (mat.channels() == 4) {
+        cv::cvtColor(mat, buffer, cv::COLOR_BGRA2BGR);
+    } else {
+        throw std::runtime_error("Unsupported number of channels: " + std::to_string(mat.channels()));
     }
 
-    return dlib_mat;
+    return dlib::cv_image<dlib::bgr_pixel>(buffer);
 }
 
 } // namespace detection
@@ -0,0 +1,84 @@
+#ifndef DNN_FACE_DETECTION_MODEL_H
+#define DNN_FACE_DETECTION_MODEL_H
+
+#include <string>
+#include <vector>
+
+#include <opencv2/dnn.hpp>
+#include <opencv2/opencv.hpp>
+
+#include "face_detection_model.h"
+#include "rect.h"
+
+namespace {
+
+// in pixels, frames are resized to the input of the network
+const int DEFAULT_DNN_DETECTOR_INPUT_WIDTH = 300;
+const int DEFAULT_DNN_DETECTOR_INPUT_HEIGHT = 300;
+const double DEFAULT_DNN_DETECTOR_CONFIDENCE = 0.5;
+// zero keeps the number of threads chosen by OpenCV
+const int DEFAULT_DNN_DETECTOR_THREADS = 0;
+const std::string DEFAULT_DNN_DETECTOR_CONFIG_FILE_PATH = "deploy.prototxt";
+const std::string DEFAULT_DNN_DETECTOR_MODEL_FILE_PATH = "res10_300x300_ssd_iter_140000.caffemodel";
+
+} // namespace
+
+namespace detection {
+
+/**
+ * Face detector built on a small SSD network run by cv::dnn on CPU,
+ * like the ResNet-10 SSD shipped with the OpenCV samples.
+ *
+ * The network sees frames resized to its input size, so the cost
+ * of a frame does not depend on its resolution and the detection
+ * scale is not used. Faces are cropped from the original frames.
+ * Batches of frames go through the network as one blob.
+ *
+ * The network is not thread-safe and is shared between copies
+ * of the model, so a model should be used by one thread at a time.
+ */
+class DnnFaceDetectionModel: public FaceDetectionModel {
+public:
+  struct Parameters {
+  public:
+    int input_width;
+    int input_height;
+    double confidence_threshold;
+    // OpenCV has one thread pool, so the number
+    // of threads is set for the whole process
+    int threads;
+
+    Parameters(int input_width = DEFAULT_DNN_DETECTOR_INPUT_WIDTH,
+               int input_height = DEFAULT_DNN_DETECTOR_INPUT_HEIGHT,
+               double confidence_threshold = DEFAULT_DNN_DETECTOR_CONFIDENCE,
+               int threads = DEFAULT_DNN_DETECTOR_THREADS);
+    Parameters(const Parameters& that);
+    Parameters& operator=(const Parameters& that);
+
+    ~Parameters() = default;
+  };
+
+  explicit DnnFaceDetectionModel(const Parameters& parameters = Parameters(),
+                                 const std::string& config_file_path = DEFAULT_DNN_DETECTOR_CONFIG_FILE_PATH,
+                                 const std::string& model_file_path = DEFAULT_DNN_DETECTOR_MODEL_FILE_PATH);
+  DnnFaceDetectionModel(const DnnFaceDetectionModel& that);
+  DnnFaceDetectionModel& operator=(const DnnFaceDetectionModel& that);
+
+  std::vector<Face> extractFaces(const Rect& viewport, cv::Mat& image) override;
+
+  std::vector<std::vector<Face>> extractFacesBatch(const std::vector<Rect>& viewports,
+                                                   std::vector<cv::Mat>& images) override;
+
+  ~DnnFaceDetectionModel() = default;
+
+private:
+  Parameters _parameters;
+  cv::dnn::Net _net;
+
+  // colour copies of greyscale frames
+  std::vector<cv::Mat> _colour_buffers;
+};
+
+} // namespace detection
+
+#endif //DNN_FACE_DETECTION_MODEL_H
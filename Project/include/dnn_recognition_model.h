@@ -1,6 +1,7 @@
 #ifndef DNN_RECOGNITION_MODEL_H
 #define DNN_RECOGNITION_MODEL_H
 
+#include <memory>
 #include <vector>
 #include <string>
 
@@ -11,7 +12,10 @@
 #include <opencv2/ml.hpp>
 #include <opencv2/opencv.hpp>
 
+#include "embedding_index.h"
 #include "face_recognition_model.h"
+#include "model_registry.h"
+#include "object_pool.h"
 
 namespace {
 
@@ -49,8 +53,11 @@ using face_recognition_dnn_model = dlib::loss_metric<dlib::fc_no_bias<128,dlib::
 
 const double DEFAULT_UNKNOWN_MAX_DISTANCE = 0.7;
 const uint32_t DEFAULT_CONSIDERED_NEIGHBOURS = 100;
+// zero stands for the number of hardware threads
+const uint32_t DEFAULT_INFERENCE_CONTEXTS = 0;
 const std::string DEFAULT_LANDMARK_MODEL_FILE_PATH = "shape_predictor_68_face_landmarks.dat";
 const std::string DEFAULT_DNN_MODEL_FILE_PATH = "dlib_face_recognition_resnet_model_v1.dat";
+const std::string GALLERY_FILE_EXTENSION = ".gallery";
 
 } // namespace
 
@@ -60,38 +67,130 @@ namespace detection {
  * Deep neural network recognition model.
 */
 class DnnRecognitionModel: public FaceRecognitionModel {
+public:
+  enum class GalleryFormat {
+    // binary file next to the model, mapped into memory on read
+    BINARY = 0,
+    // cv::ml::KNearest node inside of the model file
+    YAML = 1
+  };
+
 private:
   static const uint32_t DEFAULT_VECTOR_SIZE = 128;
 
   double _unknown_max_distance;
   uint32_t _considered_neighbours;
 
+  uint32_t _inference_contexts;
+
   std::string _dnn_model_file;
   std::string _landmarks_model_file;
-  dlib::shape_predictor _shape_predictor;
-  face_recognition_dnn_model _face_recognition_dnn_model;
-
-
-  cv::Ptr<cv::ml::KNearest> _knearest;
-
-  std::vector<double> extractFeatures(const cv::Mat& mat) const;
+  // weights are loaded in the background by the process-wide
+  // registry, every file is deserialised once per process;
+  // shape predictor is stateless during prediction,
+  // therefore it is safe to share it between threads
+  ModelRegistry::Handle<dlib::shape_predictor> _shape_predictor;
+  // dlib networks keep intermediate outputs inside,
+  // so every thread leases its own copy of the network
+  std::shared_ptr<ObjectPool<face_recognition_dnn_model>> _inference_pool;
+
+  GalleryFormat _gallery_format;
+  // descriptors of known faces and their labels,
+  // the gallery is immutable and shared between copies
+  std::shared_ptr<const EmbeddingGallery> _gallery;
+  std::shared_ptr<EmbeddingIndex> _index;
+
+  /**
+   * Requests the weights from the registry without waiting for them.
+   */
+  void requestModels();
+
+  void buildIndex();
+
+  static std::shared_ptr<const EmbeddingGallery> ReadGallery(const cv::FileStorage& file_storage,
+                                                             const std::string& file);
+
+  static std::shared_ptr<const EmbeddingGallery> ReadKNearestGallery(const cv::FileNode& node);
+
+  /**
+   * Majority vote among the neighbours,
+   * ties are resolved in favour of the smallest label
+   * the same way cv::ml::KNearest does.
+   */
+  static int Vote(const std::vector<Neighbour>& neighbours);
+
+  dlib::matrix<dlib::rgb_pixel> extractFaceChip(const cv::Mat& mat) const;
+
+  /**
+   * Runs the network once over all the given faces.
+   * Returns a matrix where every row is a descriptor
+   * of the corresponding face.
+   */
+  cv::Mat extractFeatures(const std::vector<cv::Mat>& mats) const;
 
 public:
   DnnRecognitionModel(double unknown_max_distance = DEFAULT_UNKNOWN_MAX_DISTANCE,
                       uint32_t considered_neighbours = DEFAULT_CONSIDERED_NEIGHBOURS,
                       const std::string& landmarks_model_file = DEFAULT_LANDMARK_MODEL_FILE_PATH,
-                      const std::string& dnn_model_file = DEFAULT_DNN_MODEL_FILE_PATH);
+                      const std::string& dnn_model_file = DEFAULT_DNN_MODEL_FILE_PATH,
+                      uint32_t inference_contexts = DEFAULT_INFERENCE_CONTEXTS);
   DnnRecognitionModel(const DnnRecognitionModel& that);
   DnnRecognitionModel& operator=(const DnnRecognitionModel& that);
 
+  /**
+   * Replaces the nearest neighbours index, exact search is used by default.
+   * The index is rebuilt from the current gallery right away
+   * and after every {@code train} or {@code read}.
+   */
+  void setEmbeddingIndex(const std::shared_ptr<EmbeddingIndex>& index);
+
+  /**
+   * Blocks until the weights are loaded, rethrows loading errors.
+   * Predictions wait for the weights on their own,
+   * this is only needed to load them at a known moment.
+   */
+  void waitForModels() const;
+
+  /**
+   * Sets how {@code write} stores the gallery, binary by default.
+   * Both formats are understood by {@code read}.
+   */
+  void setGalleryFormat(GalleryFormat gallery_format);
+
+  /**
+   * Reads the gallery of a model written by {@code write}
+   * without loading any networks.
+   */
+  static std::shared_ptr<const EmbeddingGallery> ReadGallery(const std::string& file);
+
   void write(const std::string& file) override;
   void read(const std::string& file) override;
 
   void train(std::vector<cv::Mat>& images,
              std::vector<int>& images_labels) override;
 
+  /**
+   * Thread-safe: concurrent calls lease different
+   * instances of the network from the inference pool.
+   */
   int predict(cv::Mat& image) const override;
 
+  using FaceRecognitionModel::predictBatch;
+
+  /**
+   * Extracts landmarks for every face, then runs the network
+   * and the nearest neighbours search once for the whole batch.
+   * Scores are similarities to the closest neighbours, from [0, 1].
+   */
+  std::vector<int> predictBatch(const std::vector<cv::Mat>& images,
+                                std::vector<double>& out_scores) const override;
+
+  /**
+   * Every neighbour votes for its label with its similarity,
+   * faces too far from the gallery vote only for the unknown label.
+   */
+  std::vector<RecognitionEvidence> predictEvidence(const std::vector<cv::Mat>& images) const override;
+
   ~DnnRecognitionModel() = default;
 };
 
@@ -0,0 +1,93 @@
+#ifndef EMBEDDING_GALLERY_H
+#define EMBEDDING_GALLERY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "aligned_allocator.h"
+
+namespace detection {
+
+/**
+ * Immutable set of labelled embeddings the indices search over.
+ *
+ * Embeddings are row-major float32 vectors, every row starts
+ * on a cache line and is padded with zeros up to {@code stride()}.
+ * The gallery either owns its memory or maps a binary gallery
+ * file into memory and uses it as is, without parsing.
+ *
+ * Binary layout, little-endian:
+ *  - 64 bytes header: magic, version, byte order mark,
+ *    number of embeddings, dimensions, stride,
+ *    offsets of the labels and the embeddings;
+ *  - int32 labels, one per embedding;
+ *  - zero padding up to the row alignment;
+ *  - float32 embeddings, {@code stride} floats per row.
+ */
+class EmbeddingGallery {
+public:
+  static const size_t ROW_ALIGNMENT = 64;
+  static const uint32_t FORMAT_VERSION = 1;
+
+  /**
+   * Copies {@code count} row-major embeddings
+   * of {@code dimensions} floats and their labels.
+   */
+  static std::shared_ptr<const EmbeddingGallery> FromRows(const float* embeddings,
+                                                          const int32_t* labels,
+                                                          size_t count,
+                                                          size_t dimensions);
+
+  /**
+   * Maps a binary gallery file into memory, pages
+   * are loaded by the system on the first access.
+   */
+  static std::shared_ptr<const EmbeddingGallery> Map(const std::string& file);
+
+  EmbeddingGallery(const EmbeddingGallery& that) = delete;
+  EmbeddingGallery& operator=(const EmbeddingGallery& that) = delete;
+
+  void write(const std::string& file) const;
+
+  size_t size() const;
+
+  size_t dimensions() const;
+
+  /**
+   * Distance between starts of the rows in floats.
+   */
+  size_t stride() const;
+
+  const float* embeddings() const;
+
+  const float* embedding(size_t index) const;
+
+  const int32_t* labels() const;
+
+  ~EmbeddingGallery();
+
+private:
+  size_t _count;
+  size_t _dimensions;
+  size_t _stride;
+
+  const float* _embeddings;
+  const int32_t* _labels;
+
+  // storage of the gallery built in memory
+  std::vector<float, AlignedAllocator<float, ROW_ALIGNMENT>> _embeddings_storage;
+  std::vector<int32_t> _labels_storage;
+
+  // mapped file, empty for the gallery built in memory
+  void* _mapping;
+  size_t _mapping_size;
+
+  EmbeddingGallery();
+};
+
+} // namespace detection
+
+#endif //EMBEDDING_GALLERY_H
@@ -0,0 +1,67 @@
+#ifndef EMBEDDING_INDEX_H
+#define EMBEDDING_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "embedding_gallery.h"
+
+namespace detection {
+
+struct Neighbour {
+public:
+  int32_t label;
+  // squared euclidean distance, the same
+  // metric cv::ml::KNearest reports
+  float distance;
+
+  Neighbour():
+      label(0),
+      distance(0) {
+      // empty on purpose
+  }
+
+  Neighbour(int32_t label, float distance):
+      label(label),
+      distance(distance) {
+      // empty on purpose
+  }
+
+  ~Neighbour() = default;
+};
+
+/**
+ * An abstract nearest neighbours index over
+ * labelled embeddings of the same dimensionality.
+ *
+ * The index is built once and then can be
+ * searched from several threads at the same time.
+ */
+class EmbeddingIndex {
+public:
+  /**
+   * Replaces content of the index. The index keeps
+   * the gallery and searches over its memory directly.
+   */
+  virtual void build(const std::shared_ptr<const EmbeddingGallery>& gallery) = 0;
+
+  virtual size_t size() const = 0;
+
+  virtual size_t dimensions() const = 0;
+
+  /**
+   * Finds up to {@code k} neighbours of the query,
+   * the closest neighbour goes first.
+   */
+  virtual void search(const float* query,
+                      size_t k,
+                      std::vector<Neighbour>& out_neighbours) const = 0;
+
+  virtual ~EmbeddingIndex() = default;
+};
+
+} // namespace detection
+
+#endif //EMBEDDING_INDEX_H
@@ -0,0 +1,44 @@
+#ifndef EXACT_EMBEDDING_INDEX_H
+#define EXACT_EMBEDDING_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "embedding_index.h"
+
+namespace detection {
+
+/**
+ * Brute force index: compares the query with every
+ * embedding, therefore always finds the true neighbours.
+ *
+ * Distances are computed right over the gallery memory
+ * by the vector kernel the processor supports.
+ */
+class ExactEmbeddingIndex: public EmbeddingIndex {
+private:
+  std::shared_ptr<const EmbeddingGallery> _gallery;
+
+public:
+  ExactEmbeddingIndex();
+  ExactEmbeddingIndex(const ExactEmbeddingIndex& that);
+  ExactEmbeddingIndex& operator=(const ExactEmbeddingIndex& that);
+
+  void build(const std::shared_ptr<const EmbeddingGallery>& gallery) override;
+
+  size_t size() const override;
+
+  size_t dimensions() const override;
+
+  void search(const float* query,
+              size_t k,
+              std::vector<Neighbour>& out_neighbours) const override;
+
+  ~ExactEmbeddingIndex() = default;
+};
+
+} // namespace detection
+
+#endif //EXACT_EMBEDDING_INDEX_H
@@ -7,6 +7,18 @@
 
 #include "rect.h"
 
+namespace {
+
+// side of the searched region relative to the predicted face
+const double DEFAULT_ROI_EXPANSION = 2.0;
+// faces found around a predicted face can be this
+// many times smaller or larger than the prediction
+const double DEFAULT_ROI_SIZE_TOLERANCE = 1.5;
+// frames are searched for faces at full resolution
+const double DEFAULT_DETECTION_SCALE = 1.0;
+
+} // namespace
+
 namespace detection {
 
 struct Eyes {
@@ -75,13 +87,84 @@ public:
   ~Face() = default;
 };
 
+/**
+ * Finds faces on frames.
+ *
+ * Whole frames can be searched at a lower resolution, which is much
+ * cheaper for large frames and still finds faces that are large enough.
+ * Faces are always located and cropped at full resolution,
+ * so recognition does not suffer from the lower detection scale.
+ */
 class FaceDetectionModel {
 protected:
+  double _detection_scale;
+
   bool shouldClip(const Rect& viewport, const Rect& face_origin) const;
 
+  /**
+   * Regions to search around the predicted faces,
+   * expanded and clipped by the viewport.
+   */
+  std::vector<Rect> searchRegions(const Rect& viewport, const std::vector<Rect>& rois) const;
+
+  /**
+   * Adds the face unless the same face has already been found,
+   * neighbouring regions may overlap.
+   */
+  static void AppendUnique(std::vector<Face>& faces, const Face& face);
+
+  /**
+   * The image resized to the detection scale,
+   * the image itself if it is searched at full resolution.
+   */
+  cv::Mat downscale(const cv::Mat& image, cv::Mat& buffer) const;
+
+  /**
+   * Maps a rect found on the downscaled image back to the full
+   * resolution image. Rounding is outwards, so the rect may
+   * leave the image if the face touches its border.
+   */
+  cv::Rect toFullResolution(const cv::Rect& rect) const;
+
 public:
+  explicit FaceDetectionModel(double detection_scale = DEFAULT_DETECTION_SCALE);
+  FaceDetectionModel(const FaceDetectionModel& that);
+  FaceDetectionModel& operator=(const FaceDetectionModel& that);
+
+  /**
+   * @param scale from (0, 1], 0.5 searches faces
+   * on frames of half the width and height.
+   */
+  void setDetectionScale(double scale);
+
+  double detectionScale() const;
+
   virtual std::vector<Face> extractFaces(const Rect& viewport, cv::Mat& image) = 0;
 
+  /**
+   * Searches faces only around the predicted ones, like the faces
+   * followed by the tracker, instead of the whole frame. Every region
+   * of interest is a predicted face, the search covers its neighbourhood.
+   * New faces away from the predictions are not found, so the whole
+   * frame still needs to be scanned from time to time.
+   *
+   * The default implementation runs the whole-frame detection
+   * on every region.
+   */
+  virtual std::vector<Face> extractFaces(const Rect& viewport,
+                                         cv::Mat& image,
+                                         const std::vector<Rect>& rois);
+
+  /**
+   * Searches faces on many frames at once, faces of every frame
+   * are returned in the order of the frames. Backends that run
+   * a network pass all the frames through it in one batch.
+   *
+   * The default implementation searches frames one by one.
+   */
+  virtual std::vector<std::vector<Face>> extractFacesBatch(const std::vector<Rect>& viewports,
+                                                           std::vector<cv::Mat>& images);
+
   virtual ~FaceDetectionModel() = default;
 };
 
@@ -1,6 +1,7 @@
 #ifndef FACE_RECOGNITION_MODEL_H
 #define FACE_RECOGNITION_MODEL_H
 
+#include <utility>
 #include <vector>
 #include <string>
 
@@ -8,6 +9,24 @@
 
 namespace detection {
 
+/**
+ * Everything the model has found out about one face.
+ */
+struct RecognitionEvidence {
+public:
+  // the decision of the model
+  int label;
+  // NaN if the model cannot estimate its confidence
+  double score;
+  // how strongly the face resembles every label, weights sum up to 1,
+  // a confident unknown face votes only for {@code LABEL_UNKNOWN}
+  std::vector<std::pair<int, double>> votes;
+
+  RecognitionEvidence();
+
+  ~RecognitionEvidence() = default;
+};
+
 /**
  * An abstract class for a face recognition model.
  * Any recognition model is an algorithm to extract
@@ -24,6 +43,30 @@ public:
                      std::vector<int>& images_labels) = 0;
   virtual int predict(cv::Mat& image) const = 0;
 
+  /**
+   * Predicts labels for all the given faces.
+   */
+  std::vector<int> predictBatch(const std::vector<cv::Mat>& images) const;
+
+  /**
+   * Predicts labels for all the given faces and
+   * reports how confident the model is in every label,
+   * NaN if the model cannot estimate its confidence.
+   * The default implementation calls {@code predict}
+   * for every face, models that can share work
+   * between faces should override it.
+   */
+  virtual std::vector<int> predictBatch(const std::vector<cv::Mat>& images,
+                                        std::vector<double>& out_scores) const;
+
+  /**
+   * Same as {@code predictBatch}, but keeps the votes behind every
+   * decision, so they can be accumulated over several frames.
+   * The default implementation gives the whole vote
+   * to the predicted label.
+   */
+  virtual std::vector<RecognitionEvidence> predictEvidence(const std::vector<cv::Mat>& images) const;
+
   virtual ~FaceRecognitionModel() = default;
 };
 
@@ -1,6 +1,7 @@
 #ifndef FACE_TRACKING_MODEL_H
 #define FACE_TRACKING_MODEL_H
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -10,8 +11,25 @@
 #include "face_utils.h"
 #include "rect.h"
 
+namespace {
+
+// detections overlapping a track at least this much continue it
+const double DEFAULT_TRACKING_MIN_IOU = 0.3;
+
+} // namespace
+
 namespace detection {
 
+/**
+ * Follows faces between keyframes.
+ *
+ * Every face gets a track with an id that stays the same while the
+ * face keeps being detected close to where it has been tracked:
+ * on reset, new detections are matched to the existing tracks by IoU
+ * and the matched trackers are seeded again in place. Only detections
+ * without a track start new ones, and only tracks without a detection
+ * are dropped.
+ */
 class FaceTrackingModel {
 public:
   enum class Model {
@@ -21,10 +39,15 @@ public:
       MIL,
       // fast but makes a lot of errors
       CSRT,
-      GOTURN
+      GOTURN,
+      // built-in correlation filter, the fastest one,
+      // reuses its memory between resets and reports
+      // the peak-to-sidelobe ratio as its confidence
+      MOSSE
   };
 
-  explicit FaceTrackingModel(FaceTrackingModel::Model model);
+  explicit FaceTrackingModel(FaceTrackingModel::Model model,
+                             double min_iou = DEFAULT_TRACKING_MIN_IOU);
   FaceTrackingModel(const FaceTrackingModel& that);
   FaceTrackingModel& operator=(const FaceTrackingModel& that);
 
@@ -32,15 +55,66 @@ public:
                      std::vector<std::string>& labels,
                      std::vector<Rect>& faces_origins);
 
+  /**
+   * Starts tracking of the given faces,
+   * labels are not needed to track faces.
+   */
+  void resetTracking(cv::Mat& frame,
+                     const std::vector<Rect>& faces_origins);
+
+  /**
+   * Forgets all the tracks, so the next reset starts new ones.
+   * Used when a new shot starts and faces at the same place
+   * are likely different people.
+   */
+  void dropTracks();
+
+  /**
+   * Ids of the tracks, in the same order faces
+   * have been passed to {@code resetTracking}.
+   */
+  const std::vector<uint64_t>& trackIds() const;
+
   void track(cv::Mat& frame,
              std::vector<std::string>& labels,
              std::vector<Rect>& out_faces_origins);
 
+  /**
+   * Appends one rect per tracked face to {@code out_faces_origins},
+   * in the same order faces have been passed to {@code resetTracking}.
+   * Trackers are updated in parallel on the shared thread pool.
+   */
+  void track(cv::Mat& frame,
+             std::vector<Rect>& out_faces_origins);
+
+  /**
+   * Same as above, also appends one confidence from [0, 1] per face.
+   * MOSSE reports its own confidence. OpenCV trackers do not expose
+   * their scores, so the confidence is estimated from the motion of
+   * the rect: it is zero for lost faces and drops with sudden jumps,
+   * sudden changes of scale, and with the part of the face that
+   * has left the frame.
+   */
+  void track(cv::Mat& frame,
+             std::vector<Rect>& out_faces_origins,
+             std::vector<double>& out_confidences);
+
   virtual ~FaceTrackingModel() = default;
 
 private:
   FaceTrackingModel::Model _model;
+  double _min_iou;
+  // may keep spare trackers to reuse,
+  // only the first {@code _trackers_count} are in use
   std::vector<cv::Ptr<cv::Tracker>> _trackers;
+  size_t _trackers_count;
+  std::vector<uint64_t> _track_ids;
+  uint64_t _next_track_id;
+  // the latest known rect of every tracker
+  std::vector<cv::Rect> _last_origins;
+  cv::Mat _grey_frame;
+
+  const cv::Mat& prepareFrame(const cv::Mat& frame);
 };
 
 } // namespace detection
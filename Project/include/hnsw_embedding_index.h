@@ -0,0 +1,98 @@
+#ifndef HNSW_EMBEDDING_INDEX_H
+#define HNSW_EMBEDDING_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "embedding_index.h"
+
+namespace detection {
+
+/**
+ * Approximate nearest neighbours index based on
+ * Hierarchical Navigable Small World graphs,
+ * see Malkov & Yashunin, arXiv:1603.09320.
+ *
+ * Every embedding is a node of a multi-layer proximity graph,
+ * the search greedily descends from the sparse top layer
+ * to the dense bottom layer. Recall and latency are traded
+ * with {@code ef_search}: the number of candidates kept
+ * during the bottom layer search.
+ */
+class HnswEmbeddingIndex: public EmbeddingIndex {
+public:
+  struct Parameters {
+  public:
+    // maximum number of links per node on upper layers,
+    // the bottom layer allows twice as many
+    uint32_t m;
+    // candidates considered while building the graph,
+    // higher values build better graphs slower
+    uint32_t ef_construction;
+    // candidates considered while searching, higher
+    // values give better recall and higher latency
+    uint32_t ef_search;
+    uint32_t seed;
+
+    Parameters(uint32_t m = 16,
+               uint32_t ef_construction = 200,
+               uint32_t ef_search = 64,
+               uint32_t seed = 42);
+    Parameters(const Parameters& that);
+    Parameters& operator=(const Parameters& that);
+
+    ~Parameters() = default;
+  };
+
+  explicit HnswEmbeddingIndex(const Parameters& parameters = Parameters());
+  HnswEmbeddingIndex(const HnswEmbeddingIndex& that);
+  HnswEmbeddingIndex& operator=(const HnswEmbeddingIndex& that);
+
+  void setEfSearch(uint32_t ef_search);
+
+  void build(const std::shared_ptr<const EmbeddingGallery>& gallery) override;
+
+  size_t size() const override;
+
+  size_t dimensions() const override;
+
+  void search(const float* query,
+              size_t k,
+              std::vector<Neighbour>& out_neighbours) const override;
+
+  ~HnswEmbeddingIndex() = default;
+
+private:
+  typedef std::pair<float, uint32_t> Candidate;
+
+  Parameters _parameters;
+  std::shared_ptr<const EmbeddingGallery> _gallery;
+  // _links[node][layer] are neighbours of the node on the layer
+  std::vector<std::vector<std::vector<uint32_t>>> _links;
+  uint32_t _entry_point;
+  int32_t _top_layer;
+
+  float distance(const float* query, uint32_t node) const;
+
+  uint32_t greedySearch(const float* query, uint32_t entry_point, int32_t layer) const;
+
+  /**
+   * Returns up to {@code ef} closest nodes found on the layer,
+   * sorted from the closest one.
+   */
+  std::vector<Candidate> searchLayer(const float* query,
+                                     uint32_t entry_point,
+                                     size_t ef,
+                                     int32_t layer) const;
+
+  std::vector<uint32_t> selectNeighbours(const std::vector<Candidate>& candidates,
+                                         size_t max_links) const;
+
+  void insert(uint32_t node, int32_t level);
+};
+
+} // namespace detection
+
+#endif //HNSW_EMBEDDING_INDEX_H
@@ -0,0 +1,127 @@
+#ifndef KEYFRAME_SCHEDULER_H
+#define KEYFRAME_SCHEDULER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace {
+
+// in frames, the interval detection starts with
+// and falls back to when the scene gets busy
+const uint32_t DEFAULT_KEYFRAME_BASE_INTERVAL = 10;
+// in frames, the longest a quiet scene goes without detection
+const uint32_t DEFAULT_KEYFRAME_MAX_INTERVAL = 40;
+// in frames, trackers need a few frames to settle
+// before their failures tell anything
+const uint32_t DEFAULT_KEYFRAME_MIN_INTERVAL = 2;
+const double DEFAULT_KEYFRAME_MIN_TRACKING_CONFIDENCE = 0.4;
+// in milliseconds, zero means no budget
+const double DEFAULT_KEYFRAME_FRAME_BUDGET = 0;
+
+} // namespace
+
+namespace detection {
+
+/**
+ * Decides for every frame whether the face detector should run
+ * or the faces of the latest keyframe should be tracked.
+ *
+ * Detection is forced on the first frame, on scene cuts, and once
+ * the scene has gone {@code max_interval} frames without it.
+ * Lost faces and low tracking confidence ask for detection after
+ * {@code min_interval} frames. Otherwise detection happens every
+ * {@code interval} frames, and the interval doubles, up to
+ * {@code max_interval}, every time a scan of the whole frame only
+ * confirms what the trackers have been following, so quiet scenes
+ * are mostly tracked. Scans around the tracked faces cannot see faces
+ * that have just entered the frame, so they never confirm anything.
+ *
+ * With a positive frame budget, detections that are not forced are
+ * postponed until frames cheaper than the budget have saved enough
+ * time to pay for the detector.
+ */
+class KeyframeScheduler {
+public:
+  struct Parameters {
+  public:
+    uint32_t base_interval;
+    uint32_t max_interval;
+    uint32_t min_interval;
+    double min_tracking_confidence;
+    double frame_budget_ms;
+
+    Parameters(uint32_t base_interval = DEFAULT_KEYFRAME_BASE_INTERVAL,
+               uint32_t max_interval = DEFAULT_KEYFRAME_MAX_INTERVAL,
+               uint32_t min_interval = DEFAULT_KEYFRAME_MIN_INTERVAL,
+               double min_tracking_confidence = DEFAULT_KEYFRAME_MIN_TRACKING_CONFIDENCE,
+               double frame_budget_ms = DEFAULT_KEYFRAME_FRAME_BUDGET);
+    Parameters(const Parameters& that);
+    Parameters& operator=(const Parameters& that);
+
+    ~Parameters() = default;
+  };
+
+  struct Stats {
+  public:
+    uint64_t frames;
+    uint64_t keyframes;
+    // keyframes forced by scene cuts
+    uint64_t scene_cuts;
+    // keyframes requested because of lost or doubtful faces
+    uint64_t tracking_alarms;
+  };
+
+  explicit KeyframeScheduler(const Parameters& parameters = Parameters());
+  KeyframeScheduler(const KeyframeScheduler& that);
+  KeyframeScheduler& operator=(const KeyframeScheduler& that);
+
+  /**
+   * Decides whether the next frame is a keyframe.
+   * @param is_scene_cut the frame starts a new shot,
+   * see {@code SceneCutDetector}.
+   */
+  bool isKeyframe(bool is_scene_cut);
+
+  /**
+   * Reports the result of detection on the keyframe.
+   * @param is_full_scan the whole frame has been searched,
+   * not only the surroundings of the tracked faces.
+   */
+  void onDetected(size_t faces_count, double elapsed_ms, bool is_full_scan = true);
+
+  /**
+   * Reports the result of tracking on a regular frame,
+   * one confidence from [0, 1] per face, zero for lost faces.
+   */
+  void onTracked(const std::vector<double>& confidences, double elapsed_ms);
+
+  Stats stats() const;
+
+  ~KeyframeScheduler() = default;
+
+private:
+  Parameters _parameters;
+
+  uint32_t _interval;
+  uint32_t _frames_since_keyframe;
+  bool _has_keyframe;
+  // faces followed since the latest keyframe
+  size_t _tracked_faces;
+  // something went wrong since the latest keyframe
+  bool _has_tracking_alarm;
+
+  // moving averages of the costs, in milliseconds
+  double _detection_cost;
+  double _tracking_cost;
+  // time saved by frames cheaper than the budget
+  double _budget_credit;
+
+  Stats _stats;
+
+  void spend(double elapsed_ms);
+};
+
+} // namespace detection
+
+#endif //KEYFRAME_SCHEDULER_H
@@ -0,0 +1,57 @@
+#ifndef MAT_ARENA_H
+#define MAT_ARENA_H
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+namespace detection {
+
+/**
+ * Reusable image buffers for hot loops.
+ *
+ * Every buffer is handed out as a view of the requested size, so
+ * buffers only grow and images of different sizes share them.
+ * Views may outlive the call that acquired them, like faces that
+ * go down the pipeline, therefore a buffer is only reused once
+ * nobody refers to it anymore and new buffers are added meanwhile.
+ * In the steady state the arena keeps as many buffers as there
+ * are images in flight and stops allocating memory.
+ *
+ * An arena is used by one thread at a time.
+ */
+class MatArena {
+public:
+  /**
+   * @param allocations counter increased on every allocation,
+   * it may be shared by many arenas and should outlive the arena.
+   */
+  explicit MatArena(std::atomic<uint64_t>& allocations);
+  MatArena(const MatArena& that) = delete;
+  MatArena& operator=(const MatArena& that) = delete;
+
+  cv::Mat acquire(int rows, int cols, int type);
+
+  /**
+   * Number of buffers owned by the arena.
+   */
+  size_t size() const;
+
+  /**
+   * Whether other matrices refer to the memory
+   * of the given one, like views or copies of its header.
+   */
+  static bool IsShared(const cv::Mat& buffer);
+
+  ~MatArena() = default;
+
+private:
+  std::vector<cv::Mat> _buffers;
+  std::atomic<uint64_t>& _allocations;
+};
+
+} // namespace detection
+
+#endif //MAT_ARENA_H
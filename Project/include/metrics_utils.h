@@ -54,17 +54,18 @@ constexpr int MB_ACCURACY         =   2;
 
 static void PrintBinaryMatrix(const std::string& title,
                               const detection::BinaryClassificationMatrix& matrix,
-                              const int flags = PB_CONFUSION_SCORES | PB_F1) {
+                              const int flags = PB_CONFUSION_SCORES | PB_F1,
+                              std::ostream& os = std::cout) {
     std::string indent = "    ";
-    std::cout << title << ":" << std::endl;
+    os << title << ":" << std::endl;
 
     if (matrix.empty()) {
-        std::cout << indent << "metrics have not been observed" << std::endl;
+        os << indent << "metrics have not been observed" << std::endl;
         return;
     }
 
     if ((flags & PB_CONFUSION_SCORES) != 0) {
-        std::cout << indent
+        os << indent
             << "tp=" << ValueToString(matrix.tp)
             << ", tn=" << ValueToString(matrix.tn)
             << ", fp=" << ValueToString(matrix.fp)
@@ -72,54 +73,55 @@ static void PrintBinaryMatrix(const std::string& title,
     }
 
     if ((flags & PB_PRECISION) != 0) {
-        std::cout << FormatValue(indent, "precision=", matrix.precision()) << std::endl;
+        os << FormatValue(indent, "precision=", matrix.precision()) << std::endl;
     }
 
     if ((flags & PB_RECALL) != 0 || (flags & PB_TPR) != 0) {
-        std::cout << FormatValue(indent, "recall (aka TPR)=", matrix.recall())<< std::endl;
+        os << FormatValue(indent, "recall (aka TPR)=", matrix.recall())<< std::endl;
     }
 
     if ((flags & PB_ACCURACY) != 0) {
-        std::cout << FormatValue(indent, "accuracy=", matrix.accuracy()) << std::endl;
+        os << FormatValue(indent, "accuracy=", matrix.accuracy()) << std::endl;
     }
 
     if ((flags & PB_F1) != 0) {
-        std::cout << FormatValue(indent, "f1=", matrix.f1()) << std::endl;
+        os << FormatValue(indent, "f1=", matrix.f1()) << std::endl;
     }
 
     if ((flags & PB_FNR) != 0) {
-        std::cout << FormatValue(indent, "FNR=", matrix.fnr()) << std::endl;
+        os << FormatValue(indent, "FNR=", matrix.fnr()) << std::endl;
     }
 
     if ((flags & PB_TNR) != 0) {
-        std::cout << FormatValue(indent, "TNR=", matrix.tnr()) << std::endl;
+        os << FormatValue(indent, "TNR=", matrix.tnr()) << std::endl;
     }
 
     if ((flags & PB_FPR) != 0) {
-        std::cout << FormatValue(indent, "FPR=", matrix.fpr()) << std::endl;
+        os << FormatValue(indent, "FPR=", matrix.fpr()) << std::endl;
     }
 }
 
 static void PrintMulticlassMatrix(const std::string& title,
                                   const detection::MultiClassificationMatrix& matrix,
-                                  const int flags = MB_CONFUSION_SCORES | MB_ACCURACY) {
+                                  const int flags = MB_CONFUSION_SCORES | MB_ACCURACY,
+                                  std::ostream& os = std::cout) {
     std::string indent = "    ";
-    std::cout << title << ":" << std::endl;
+    os << title << ":" << std::endl;
 
     if ((flags & MB_CONFUSION_SCORES) != 0) {
         for (size_t i = 0; i < matrix.classesSize(); i++) {
-            std::cout << indent;
+            os << indent;
 
             for (size_t j = 0; j < matrix.classesSize(); j++) {
-                std::cout << std::setw(3) << matrix.metricAt(i, j) << " ";
+                os << std::setw(3) << matrix.metricAt(i, j) << " ";
             }
         }
 
-        std::cout << std::endl;
+        os << std::endl;
     }
 
     if ((flags & MB_ACCURACY) != 0) {
-        std::cout << FormatValue(indent, "accuracy=", matrix.accuracy()) << std::endl;
+        os << FormatValue(indent, "accuracy=", matrix.accuracy()) << std::endl;
     }
 }
 
@@ -0,0 +1,125 @@
+#ifndef MODEL_REGISTRY_H
+#define MODEL_REGISTRY_H
+
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+
+namespace detection {
+
+/**
+ * Process-wide cache of immutable models loaded from files.
+ *
+ * Every file is loaded at most once per type, the first request
+ * starts loading in the background and all the requests for
+ * the same file share the result. A failed load is forgotten
+ * by the next request for the file, which tries again.
+ */
+class ModelRegistry {
+public:
+  struct LoadRecord {
+  public:
+    std::string file;
+    double milliseconds;
+  };
+
+  template <typename T>
+  using Loader = std::function<std::shared_ptr<const T>(const std::string& file)>;
+
+  template <typename T>
+  using Handle = std::shared_future<std::shared_ptr<const T>>;
+
+  ModelRegistry() = default;
+  ModelRegistry(const ModelRegistry& that) = delete;
+  ModelRegistry& operator=(const ModelRegistry& that) = delete;
+
+  static ModelRegistry& shared();
+
+  /**
+   * Returns immediately, {@code get} on the handle
+   * blocks until the model is loaded.
+   */
+  template <typename T>
+  Handle<T> load(const std::string& file, Loader<T> loader) {
+      const std::string key = std::string(typeid(T).name()) + "|"
+              + std::filesystem::absolute(file).lexically_normal().string();
+
+      std::lock_guard<std::mutex> lock(_mutex);
+
+      auto entry = _entries.find(key);
+      if (entry != _entries.end()) {
+          const Handle<T> cached_handle = *std::static_pointer_cast<Handle<T>>(entry->second);
+
+          if (!HasFailed(cached_handle)) {
+              return cached_handle;
+          }
+
+          // the loading task is over, so dropping
+          // its handle here never waits for it
+          _entries.erase(entry);
+      }
+
+      // the task never touches the entries, erasing the last
+      // handle from its own thread would make it wait for itself
+      Handle<T> handle = std::async(std::launch::async, [this, file, loader]() {
+          auto start = std::chrono::steady_clock::now();
+
+          std::shared_ptr<const T> model = loader(file);
+
+          std::lock_guard<std::mutex> lock(_mutex);
+          _records.push_back({ file,
+                               std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() });
+          return model;
+      }).share();
+
+      _entries[key] = std::make_shared<Handle<T>>(handle);
+      return handle;
+  }
+
+  /**
+   * Files loaded so far and how long every load took.
+   */
+  std::vector<LoadRecord> records() const {
+      std::lock_guard<std::mutex> lock(_mutex);
+      return _records;
+  }
+
+  ~ModelRegistry() = default;
+
+private:
+  mutable std::mutex _mutex;
+  std::vector<LoadRecord> _records;
+  // handles of different types, the type is a part of the key;
+  // declared last, so pending loads are awaited
+  // before the rest of the registry is destroyed
+  std::unordered_map<std::string, std::shared_ptr<void>> _entries;
+
+  /**
+   * Whether the load is over and has thrown,
+   * never blocks on a pending load.
+   */
+  template <typename T>
+  static bool HasFailed(const Handle<T>& handle) {
+      if (handle.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+          return false;
+      }
+
+      try {
+          handle.get();
+          return false;
+      } catch (...) {
+          return true;
+      }
+  }
+};
+
+} // namespace detection
+
+#endif //MODEL_REGISTRY_H
@@ -0,0 +1,121 @@
+#ifndef MOSSE_TRACKER_H
+#define MOSSE_TRACKER_H
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/tracking.hpp>
+
+namespace {
+
+// in pixels, side of the square patch the filter works on,
+// a power of two keeps the transforms fast
+const int DEFAULT_MOSSE_TEMPLATE_SIZE = 64;
+// the patch covers the face and this much of its surroundings
+const double DEFAULT_MOSSE_PADDING = 2.0;
+const double DEFAULT_MOSSE_LEARNING_RATE = 0.125;
+// in template pixels, width of the desired correlation peak
+const double DEFAULT_MOSSE_SIGMA = 2.0;
+// perturbed copies of the first patch the filter is trained on
+const int DEFAULT_MOSSE_TRAINING_SAMPLES = 8;
+// peak-to-sidelobe ratios below the first value mean a lost face,
+// ratios above the second value mean a certain one
+const double DEFAULT_MOSSE_LOST_PSR = 7.0;
+const double DEFAULT_MOSSE_CONFIDENT_PSR = 20.0;
+
+} // namespace
+
+namespace detection {
+
+/**
+ * MOSSE correlation filter tracker (Bolme et al., 2010)
+ * built for faces: it works on greyscale patches of a fixed size,
+ * so all the spectra and scratch buffers are allocated once
+ * and reused by every following {@code init} and {@code update}.
+ *
+ * The quality of every update is measured by the peak-to-sidelobe
+ * ratio of the correlation response, updates with a low ratio
+ * are reported as failures and do not spoil the filter.
+ *
+ * Frames can be either greyscale or BGR, passing greyscale frames
+ * saves a conversion per tracker when many faces are tracked.
+ */
+class MosseTracker: public cv::Tracker {
+public:
+  struct Parameters {
+  public:
+    int template_size;
+    double padding;
+    double learning_rate;
+    double sigma;
+    int training_samples;
+    double lost_psr;
+    double confident_psr;
+
+    Parameters(int template_size = DEFAULT_MOSSE_TEMPLATE_SIZE,
+               double padding = DEFAULT_MOSSE_PADDING,
+               double learning_rate = DEFAULT_MOSSE_LEARNING_RATE,
+               double sigma = DEFAULT_MOSSE_SIGMA,
+               int training_samples = DEFAULT_MOSSE_TRAINING_SAMPLES,
+               double lost_psr = DEFAULT_MOSSE_LOST_PSR,
+               double confident_psr = DEFAULT_MOSSE_CONFIDENT_PSR);
+    Parameters(const Parameters& that);
+    Parameters& operator=(const Parameters& that);
+
+    ~Parameters() = default;
+  };
+
+  static cv::Ptr<MosseTracker> create(const Parameters& parameters = Parameters());
+
+  explicit MosseTracker(const Parameters& parameters = Parameters());
+  MosseTracker(const MosseTracker& that) = delete;
+  MosseTracker& operator=(const MosseTracker& that) = delete;
+
+  void init(cv::InputArray image, const cv::Rect& bounding_box) override;
+
+  bool update(cv::InputArray image, cv::Rect& bounding_box) override;
+
+  /**
+   * Peak-to-sidelobe ratio of the latest update.
+   */
+  double psr() const;
+
+  /**
+   * Confidence of the latest update from [0, 1],
+   * zero if the face has been lost.
+   */
+  double confidence() const;
+
+  ~MosseTracker() override = default;
+
+private:
+  Parameters _parameters;
+
+  cv::Rect2d _box;
+  double _psr;
+
+  // in the frequency domain
+  cv::Mat _target;
+  cv::Mat _numerator;
+  cv::Mat _denominator;
+  cv::Mat _filter;
+
+  // scratch buffers of the fixed size
+  cv::Mat _grey;
+  cv::Mat _warp;
+  cv::Mat _raw_patch;
+  cv::Mat _patch;
+  cv::Mat _window;
+  cv::Mat _spectrum;
+  cv::Mat _product;
+  cv::Mat _energy;
+  cv::Mat _response;
+
+  void allocate();
+  cv::Mat toGrey(cv::InputArray image);
+  void extractPatch(const cv::Mat& grey, const cv::Rect2d& box, double angle, double scale);
+  void learn(double new_weight, double old_weight);
+  void computeFilter();
+};
+
+} // namespace detection
+
+#endif //MOSSE_TRACKER_H
@@ -0,0 +1,154 @@
+#ifndef OBJECT_POOL_H
+#define OBJECT_POOL_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace detection {
+
+/**
+ * A bounded pool of interchangeable objects.
+ * Objects are created by the factory at most once,
+ * on the first demand, and then leased to one thread
+ * at a time. It allows to share objects that are not
+ * thread-safe, like dlib networks, between threads
+ * without copying them on every call.
+ *
+ * The pool should outlive all leases it gave out.
+ */
+template <typename T>
+class ObjectPool {
+public:
+  typedef std::function<std::unique_ptr<T>()> Factory;
+
+  /**
+   * Exclusive ownership of a pooled object.
+   * The object goes back to the pool when
+   * the lease is destroyed.
+   */
+  class Lease {
+  private:
+    ObjectPool<T>* _pool;
+    T* _object;
+
+  public:
+    Lease(ObjectPool<T>* pool, T* object):
+        _pool(pool),
+        _object(object) {
+        // empty on purpose
+    }
+
+    Lease(Lease&& that) noexcept:
+        _pool(that._pool),
+        _object(that._object) {
+        that._pool = nullptr;
+        that._object = nullptr;
+    }
+
+    Lease(const Lease& that) = delete;
+    Lease& operator=(const Lease& that) = delete;
+
+    T& operator*() const { return *_object; }
+    T* operator->() const { return _object; }
+
+    ~Lease() {
+        if (_pool != nullptr) {
+            _pool->release(_object);
+        }
+    }
+  };
+
+  /**
+   * @param capacity the maximum number of objects,
+   * zero means the number of hardware threads.
+   */
+  ObjectPool(size_t capacity, Factory factory):
+      _capacity(capacity == 0 ? std::max(1u, std::thread::hardware_concurrency()) : capacity),
+      _factory(std::move(factory)),
+      _created(0),
+      _objects(),
+      _available(),
+      _mutex(),
+      _object_released() {
+      // empty on purpose
+  }
+
+  ObjectPool(const ObjectPool& that) = delete;
+  ObjectPool& operator=(const ObjectPool& that) = delete;
+
+  size_t capacity() const {
+      return _capacity;
+  }
+
+  /**
+   * Blocks until an object is available.
+   */
+  Lease acquire() {
+      {
+          std::unique_lock<std::mutex> lock(_mutex);
+
+          _object_released.wait(lock, [this]() {
+              return !_available.empty() || _created < _capacity;
+          });
+
+          if (!_available.empty()) {
+              T* object = _available.back();
+              _available.pop_back();
+              return Lease(this, object);
+          }
+
+          // reserving the slot, the object itself
+          // is created outside of the lock as it may be slow
+          _created += 1;
+      }
+
+      std::unique_ptr<T> object;
+      try {
+          object = _factory();
+      } catch (...) {
+          {
+              std::lock_guard<std::mutex> lock(_mutex);
+              _created -= 1;
+          }
+
+          _object_released.notify_one();
+          throw;
+      }
+
+      T* raw_object = object.get();
+
+      std::lock_guard<std::mutex> lock(_mutex);
+      _objects.push_back(std::move(object));
+      return Lease(this, raw_object);
+  }
+
+  ~ObjectPool() = default;
+
+private:
+  size_t _capacity;
+  Factory _factory;
+  size_t _created;
+  std::vector<std::unique_ptr<T>> _objects;
+  std::vector<T*> _available;
+  std::mutex _mutex;
+  std::condition_variable _object_released;
+
+  void release(T* object) {
+      {
+          std::lock_guard<std::mutex> lock(_mutex);
+          _available.push_back(object);
+      }
+
+      _object_released.notify_one();
+  }
+};
+
+} // namespace detection
+
+#endif //OBJECT_POOL_H
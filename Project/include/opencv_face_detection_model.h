@@ -1,15 +1,31 @@
 #ifndef OPENCV_FACE_DETECTION_MODEL_H
 #define OPENCV_FACE_DETECTION_MODEL_H
 
+#include <atomic>
+#include <memory>
+#include <string>
+
 #include "face_detection_model.h"
+#include "mat_arena.h"
+#include "object_pool.h"
 #include "rect.h"
 
 namespace {
 
 const double DEFAULT_FACE_SCALE_FACTOR = 1.1;
 const uint32_t DEFAULT_FACE_MIN_NEIGHBOURS = 6;
+// in pixels of the full resolution frame,
+// zero means the size is not bounded
+const uint32_t DEFAULT_MIN_FACE_SIZE = 0;
+const uint32_t DEFAULT_MAX_FACE_SIZE = 0;
 const double DEFAULT_EYES_SCALE_FACTOR = 1.1;
 const uint32_t DEFAULT_EYES_MIN_NEIGHBOURS = 6;
+// relative to the width of the face,
+// zero means the size is not bounded
+const double DEFAULT_MIN_EYE_SIZE = 0.0;
+const double DEFAULT_MAX_EYE_SIZE = 0.0;
+// search every eye only in the upper half of its own side of the face
+const bool DEFAULT_RESTRICT_EYES_SEARCH = false;
 const std::string DEFAULT_FACE_CASCADE_FILE_PATH = "haarcascade_frontalface_alt2.xml";
 const std::string DEFAULT_RIGHT_EYE_CASCADE_FILE_PATH = "haarcascade_righteye_2splits.xml";
 const std::string DEFAULT_LEFT_EYE_CASCADE_FILE_PATH = "haarcascade_lefteye_2splits.xml";
@@ -18,30 +34,155 @@ const std::string DEFAULT_LEFT_EYE_CASCADE_FILE_PATH = "haarcascade_lefteye_2spl
 
 namespace detection {
 
+/**
+ * Haar cascades face detector, faces are aligned by their eyes.
+ *
+ * Greyscale frames, aligned faces and intermediate results live in
+ * scratch buffers owned by the detector and reused between frames,
+ * so the steady state does not allocate memory besides the returned
+ * faces and OpenCV internals. Detection of one frame should not
+ * be called from many threads at once.
+ */
 class OpenCVFaceDetectionModel: public FaceDetectionModel {
+public:
+  /**
+   * Search settings of the cascades. Bounds of the face size let
+   * the cascade skip the scales that never contain a face, they can
+   * be derived from annotated videos with {@code --calibrate}.
+   */
+  struct Parameters {
+  public:
+    double face_scale_factor;
+    uint32_t face_min_neighbours;
+    uint32_t min_face_size;
+    uint32_t max_face_size;
+    double eyes_scale_factor;
+    uint32_t eyes_min_neighbours;
+    double min_eye_size;
+    double max_eye_size;
+    bool restrict_eyes_search;
+
+    Parameters(double face_scale_factor = DEFAULT_FACE_SCALE_FACTOR,
+               uint32_t face_min_neighbours = DEFAULT_FACE_MIN_NEIGHBOURS,
+               uint32_t min_face_size = DEFAULT_MIN_FACE_SIZE,
+               uint32_t max_face_size = DEFAULT_MAX_FACE_SIZE,
+               double eyes_scale_factor = DEFAULT_EYES_SCALE_FACTOR,
+               uint32_t eyes_min_neighbours = DEFAULT_EYES_MIN_NEIGHBOURS,
+               double min_eye_size = DEFAULT_MIN_EYE_SIZE,
+               double max_eye_size = DEFAULT_MAX_EYE_SIZE,
+               bool restrict_eyes_search = DEFAULT_RESTRICT_EYES_SEARCH);
+    Parameters(const Parameters& that);
+    Parameters& operator=(const Parameters& that);
+
+    /**
+     * Settings missing in the file keep their values.
+     */
+    void read(const std::string& file);
+
+    void write(const std::string& file) const;
+
+    ~Parameters() = default;
+  };
+
+  struct Stats {
+  public:
+    uint64_t frames;
+    // allocations of the scratch buffers
+    uint64_t allocations;
+  };
+
 private:
-  double _face_scale_factor;
-  uint32_t _face_min_neighbours;
-  double _eyes_scale_factor;
-  uint32_t _eyes_min_neighbours;
+  // buffers of a single eye search or face alignment, one per
+  // thread that does them, never leased across a nested parallelFor
+  struct FaceScratch {
+  public:
+    std::vector<cv::Rect> eyes;
+    MatArena aligned_faces;
+
+    explicit FaceScratch(std::atomic<uint64_t>& allocations);
+    FaceScratch(const FaceScratch& that) = delete;
+    FaceScratch& operator=(const FaceScratch& that) = delete;
+
+    ~FaceScratch() = default;
+  };
+
+  Parameters _parameters;
 
   cv::CascadeClassifier _face_cascade;
-  cv::CascadeClassifier _right_eye_cascade;
-  cv::CascadeClassifier _left_eye_cascade;
+  // cascades keep scratch buffers inside, so every thread
+  // leases its own copy to search eyes of different faces at once
+  std::shared_ptr<ObjectPool<cv::CascadeClassifier>> _right_eye_cascades;
+  std::shared_ptr<ObjectPool<cv::CascadeClassifier>> _left_eye_cascades;
+
+  // scratch buffers are never shared between copies
+  std::atomic<uint64_t> _frames;
+  std::atomic<uint64_t> _allocations;
+  MatArena _greyscale_frames;
+  cv::Mat _downscaled_frame;
+  std::vector<cv::Rect> _faces;
+  std::vector<cv::Rect> _visible_faces;
+  std::vector<cv::Mat> _aligned_faces;
+  std::vector<cv::Rect> _left_eyes;
+  std::vector<cv::Rect> _right_eyes;
+  std::unique_ptr<ObjectPool<FaceScratch>> _face_scratches;
+
+  /**
+   * Finds the eye in the given part of the face,
+   * the eye is returned in the basis of the face.
+   * Empty rect means the eye has not been found or is ambiguous.
+   */
+  cv::Rect findEye(ObjectPool<cv::CascadeClassifier>& cascades,
+                   const cv::Mat& face_area,
+                   const cv::Rect& search_area);
+
+  /**
+   * Bounds of the face size on the searched image,
+   * the image may be downscaled.
+   */
+  cv::Size minFaceSize(double scale) const;
+  cv::Size maxFaceSize(double scale) const;
+
+  /**
+   * Counts reallocations of the vectors the detector keeps.
+   */
+  void countGrowth(size_t old_capacity, size_t new_capacity);
+
+  std::unique_ptr<ObjectPool<FaceScratch>> createFaceScratches();
+
+  /**
+   * Finds eyes of the given faces and aligns them.
+   * Faces are given in the basis of the greyscale area,
+   * the area itself is at {@code area_origin} in the frame.
+   *
+   * Faces are aligned in parallel, and both eyes
+   * of a face are searched at the same time.
+   */
+  void collectFaces(const Rect& viewport,
+                    const cv::Mat& greyscale_area,
+                    const Rect& area_origin,
+                    const std::vector<cv::Rect>& faces,
+                    std::vector<Face>& out_faces);
 
 public:
- OpenCVFaceDetectionModel(double face_scale_factor = DEFAULT_FACE_SCALE_FACTOR,
-                          uint32_t face_min_neighbours = DEFAULT_FACE_MIN_NEIGHBOURS,
-                          double eyes_scale_factor = DEFAULT_EYES_SCALE_FACTOR,
-                          uint32_t eyes_min_neighbours = DEFAULT_EYES_MIN_NEIGHBOURS,
-                          const std::string& face_cascade_file_path = DEFAULT_FACE_CASCADE_FILE_PATH,
-                          const std::string& right_eye_cascade_file_path = DEFAULT_RIGHT_EYE_CASCADE_FILE_PATH,
-                          const std::string& left_eye_cascade_file_path = DEFAULT_LEFT_EYE_CASCADE_FILE_PATH);
+ explicit OpenCVFaceDetectionModel(const Parameters& parameters = Parameters(),
+                                   const std::string& face_cascade_file_path = DEFAULT_FACE_CASCADE_FILE_PATH,
+                                   const std::string& right_eye_cascade_file_path = DEFAULT_RIGHT_EYE_CASCADE_FILE_PATH,
+                                   const std::string& left_eye_cascade_file_path = DEFAULT_LEFT_EYE_CASCADE_FILE_PATH);
  OpenCVFaceDetectionModel(const OpenCVFaceDetectionModel& that);
  OpenCVFaceDetectionModel& operator=(const OpenCVFaceDetectionModel& that);
 
  std::vector<Face> extractFaces(const Rect& viewport, cv::Mat& image) override;
 
+ /**
+  * Only the regions are converted to greyscale, and the cascade
+  * only tries scales close to the size of the predicted face.
+  */
+ std::vector<Face> extractFaces(const Rect& viewport,
+                                cv::Mat& image,
+                                const std::vector<Rect>& rois) override;
+
+ Stats stats() const;
+
  ~OpenCVFaceDetectionModel() = default;
 };
 
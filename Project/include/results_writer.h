@@ -0,0 +1,53 @@
+#ifndef RESULTS_WRITER_H
+#define RESULTS_WRITER_H
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "rect.h"
+
+namespace detection {
+
+/**
+ * Writes processing results as JSON lines:
+ * every frame is a separate JSON object on its own line.
+ * {"file":"a.mp4","frame":10,"keyframe":true,"faces":[
+ *     {"x":1,"y":2,"width":3,"height":4,"label":"pegg","score":0.8}]}
+ *
+ * Faces that are no longer tracked (empty rects) are skipped,
+ * unknown scores are written as null.
+ * Lines can be written from several threads.
+ */
+class ResultsWriter {
+private:
+  std::unique_ptr<std::ofstream> _file_stream;
+  std::ostream* _stream;
+  std::mutex _stream_mutex;
+
+public:
+  /**
+   * @param file output file, results are written
+   * to the standard output if the file is empty.
+   */
+  explicit ResultsWriter(const std::string& file);
+  ResultsWriter(const ResultsWriter& that) = delete;
+  ResultsWriter& operator=(const ResultsWriter& that) = delete;
+
+  void write(const std::string& video_file,
+             uint32_t frame_id,
+             bool is_keyframe,
+             const std::vector<Rect>& faces_origins,
+             const std::vector<std::string>& labels,
+             const std::vector<double>& scores);
+
+  ~ResultsWriter() = default;
+};
+
+} // namespace detection
+
+#endif //RESULTS_WRITER_H
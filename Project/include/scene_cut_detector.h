@@ -0,0 +1,90 @@
+#ifndef SCENE_CUT_DETECTOR_H
+#define SCENE_CUT_DETECTOR_H
+
+#include <opencv2/opencv.hpp>
+
+namespace {
+
+// in pixels, frames are compared at this resolution
+const int DEFAULT_SCENE_THUMBNAIL_WIDTH = 64;
+const int DEFAULT_SCENE_THUMBNAIL_HEIGHT = 36;
+const int DEFAULT_SCENE_HISTOGRAM_BINS = 32;
+// in thumbnail pixels
+const int DEFAULT_SCENE_BLOCK_SIZE = 8;
+// mean absolute difference of a block, from [0, 1],
+// above which the block is considered changed
+const double DEFAULT_SCENE_BLOCK_THRESHOLD = 0.1;
+const double DEFAULT_SCENE_CUT_THRESHOLD = 0.2;
+
+} // namespace
+
+namespace detection {
+
+/**
+ * Finds hard cuts between shots of an edited video.
+ *
+ * Every frame is downscaled to a small grey thumbnail and compared
+ * with the previous one in two ways: the distance between grey
+ * histograms, which ignores motion, and the part of the blocks
+ * whose mean absolute difference is large, which ignores global
+ * changes of brightness that keep the picture. A cut has to change
+ * both, so the score is the smaller of the two, from [0, 1].
+ *
+ * All the work is done by vectorised OpenCV primitives on
+ * thumbnails, so the detector costs a fraction of the decoding.
+ */
+class SceneCutDetector {
+public:
+  struct Parameters {
+  public:
+    int thumbnail_width;
+    int thumbnail_height;
+    int histogram_bins;
+    int block_size;
+    double block_threshold;
+    double cut_threshold;
+
+    Parameters(int thumbnail_width = DEFAULT_SCENE_THUMBNAIL_WIDTH,
+               int thumbnail_height = DEFAULT_SCENE_THUMBNAIL_HEIGHT,
+               int histogram_bins = DEFAULT_SCENE_HISTOGRAM_BINS,
+               int block_size = DEFAULT_SCENE_BLOCK_SIZE,
+               double block_threshold = DEFAULT_SCENE_BLOCK_THRESHOLD,
+               double cut_threshold = DEFAULT_SCENE_CUT_THRESHOLD);
+    Parameters(const Parameters& that);
+    Parameters& operator=(const Parameters& that);
+
+    ~Parameters() = default;
+  };
+
+  explicit SceneCutDetector(const Parameters& parameters = Parameters());
+  SceneCutDetector(const SceneCutDetector& that);
+  SceneCutDetector& operator=(const SceneCutDetector& that);
+
+  /**
+   * Compares the frame with the previous one and remembers it.
+   * The first frame is always a cut.
+   */
+  bool isCut(const cv::Mat& frame);
+
+  /**
+   * The score of the latest frame.
+   */
+  double score() const;
+
+  ~SceneCutDetector() = default;
+
+private:
+  Parameters _parameters;
+
+  cv::Mat _previous_thumbnail;
+  cv::Mat _previous_histogram;
+  double _score;
+
+  // scratch buffers reused between frames
+  cv::Mat _difference;
+  cv::Mat _blocks;
+};
+
+} // namespace detection
+
+#endif //SCENE_CUT_DETECTOR_H
@@ -0,0 +1,215 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// failed attempts a blocked side yields the thread
+// for before it goes to sleep, short stalls are common
+// between pipeline stages and sleeping costs a system call
+const int DEFAULT_QUEUE_SPINS = 64;
+
+} // namespace
+
+namespace detection {
+
+/**
+ * Bounded lock-free queue for exactly one producer thread
+ * and exactly one consumer thread.
+ *
+ * {@code tryPush} and {@code tryPop} never block, {@code push}
+ * and {@code pop} yield the thread for a few attempts and then
+ * sleep until the other side makes progress or the queue is closed,
+ * so an idle stage does not keep a core busy. Closed queue rejects
+ * new values but still gives away values that have been pushed before.
+ */
+template <typename T>
+class SpscQueue {
+private:
+  // one slot is always kept empty to tell
+  // a full queue from an empty one
+  std::vector<T> _slots;
+  alignas(64) std::atomic<size_t> _head;
+  alignas(64) std::atomic<size_t> _tail;
+  alignas(64) std::atomic<bool> _is_closed;
+
+  // sleeping sides, only touched when a side
+  // runs out of spins or there is a sleeper to wake up
+  std::atomic<int> _sleeping_producers;
+  std::atomic<int> _sleeping_consumers;
+  std::mutex _sleep_mutex;
+  std::condition_variable _value_pushed;
+  std::condition_variable _value_popped;
+
+  size_t advance(size_t index) const {
+      index += 1;
+      return index == _slots.size() ? 0 : index;
+  }
+
+  bool isFull() const {
+      return advance(_tail.load(std::memory_order_relaxed)) == _head.load(std::memory_order_acquire);
+  }
+
+  bool isEmpty() const {
+      return _head.load(std::memory_order_relaxed) == _tail.load(std::memory_order_acquire);
+  }
+
+  template <typename Predicate>
+  void sleep(std::atomic<int>& sleepers, std::condition_variable& condition, Predicate can_proceed) {
+      std::unique_lock<std::mutex> lock(_sleep_mutex);
+      sleepers.fetch_add(1, std::memory_order_relaxed);
+      // pairs with the fence in wakeUp: either the other side
+      // sees the sleeper or the predicate sees its progress
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      condition.wait(lock, can_proceed);
+      sleepers.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  void wakeUp(std::atomic<int>& sleepers, std::condition_variable& condition) {
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+
+      if (sleepers.load(std::memory_order_relaxed) > 0) {
+          // the sleeper might be between checking
+          // the predicate and waiting on the condition
+          { std::lock_guard<std::mutex> lock(_sleep_mutex); }
+          condition.notify_one();
+      }
+  }
+
+public:
+  explicit SpscQueue(size_t capacity):
+      _slots(capacity + 1),
+      _head(0),
+      _tail(0),
+      _is_closed(false),
+      _sleeping_producers(0),
+      _sleeping_consumers(0),
+      _sleep_mutex(),
+      _value_pushed(),
+      _value_popped() {
+      if (capacity == 0) {
+          throw std::runtime_error("Queue capacity should be positive.");
+      }
+  }
+
+  SpscQueue(const SpscQueue& that) = delete;
+  SpscQueue& operator=(const SpscQueue& that) = delete;
+
+  size_t capacity() const {
+      return _slots.size() - 1;
+  }
+
+  /**
+   * Producer side only.
+   * Leaves {@code value} untouched if the queue is full.
+   */
+  bool tryPush(T& value) {
+      const size_t tail = _tail.load(std::memory_order_relaxed);
+      const size_t next_tail = advance(tail);
+
+      if (next_tail == _head.load(std::memory_order_acquire)) {
+          return false;
+      }
+
+      _slots[tail] = std::move(value);
+      _tail.store(next_tail, std::memory_order_release);
+      wakeUp(_sleeping_consumers, _value_pushed);
+      return true;
+  }
+
+  /**
+   * Consumer side only.
+   */
+  bool tryPop(T& out_value) {
+      const size_t head = _head.load(std::memory_order_relaxed);
+
+      if (head == _tail.load(std::memory_order_acquire)) {
+          return false;
+      }
+
+      out_value = std::move(_slots[head]);
+      _head.store(advance(head), std::memory_order_release);
+      wakeUp(_sleeping_producers, _value_popped);
+      return true;
+  }
+
+  /**
+   * Producer side only.
+   * Returns false if the queue has been closed.
+   */
+  bool push(T value) {
+      for (int attempt = 0; !isClosed(); attempt++) {
+          if (tryPush(value)) {
+              return true;
+          }
+
+          if (attempt < DEFAULT_QUEUE_SPINS) {
+              std::this_thread::yield();
+          } else {
+              sleep(_sleeping_producers, _value_popped, [this]() {
+                  return !isFull() || isClosed();
+              });
+          }
+      }
+
+      return false;
+  }
+
+  /**
+   * Consumer side only.
+   * Returns false if the queue has been closed and drained.
+   */
+  bool pop(T& out_value) {
+      for (int attempt = 0; true; attempt++) {
+          if (tryPop(out_value)) {
+              return true;
+          }
+
+          if (isClosed()) {
+              // the producer might have pushed the last
+              // value right before closing the queue
+              return tryPop(out_value);
+          }
+
+          if (attempt < DEFAULT_QUEUE_SPINS) {
+              std::this_thread::yield();
+          } else {
+              sleep(_sleeping_consumers, _value_pushed, [this]() {
+                  return !isEmpty() || isClosed();
+              });
+          }
+      }
+  }
+
+  /**
+   * Can be called from any thread.
+   */
+  void close() {
+      _is_closed.store(true, std::memory_order_release);
+
+      {
+          std::lock_guard<std::mutex> lock(_sleep_mutex);
+      }
+
+      _value_pushed.notify_all();
+      _value_popped.notify_all();
+  }
+
+  bool isClosed() const {
+      return _is_closed.load(std::memory_order_acquire);
+  }
+
+  ~SpscQueue() = default;
+};
+
+} // namespace detection
+
+#endif //SPSC_QUEUE_H
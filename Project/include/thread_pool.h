@@ -0,0 +1,86 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace detection {
+
+/**
+ * Work-stealing thread pool.
+ *
+ * Every worker has its own deque of tasks: a worker takes
+ * the most recent tasks from its own deque and, when the deque
+ * is empty, steals the oldest tasks from the other workers.
+ * Tasks submitted from a worker go to its own deque, the others
+ * are spread between workers.
+ *
+ * Threads that wait for {@code parallelFor} run pending tasks
+ * themselves, therefore {@code parallelFor} can be safely called
+ * from inside of the pool's tasks.
+ */
+class ThreadPool {
+public:
+  typedef std::function<void()> Task;
+
+  /**
+   * @param threads number of workers,
+   * zero means the number of hardware threads.
+   */
+  explicit ThreadPool(size_t threads = 0);
+  ThreadPool(const ThreadPool& that) = delete;
+  ThreadPool& operator=(const ThreadPool& that) = delete;
+
+  /**
+   * Process-wide pool sized to the number of hardware threads.
+   */
+  static ThreadPool& shared();
+
+  size_t size() const;
+
+  void submit(Task task);
+
+  /**
+   * Calls {@code body} for every index from [0, size)
+   * and blocks until all the calls are over.
+   * The calling thread runs calls too, so a thread from outside
+   * of the pool adds one more call running at the same time.
+   * Rethrows the first exception thrown by {@code body}.
+   */
+  void parallelFor(size_t size, const std::function<void(size_t index)>& body);
+
+  ~ThreadPool();
+
+private:
+  struct WorkQueue {
+  public:
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  std::vector<std::unique_ptr<WorkQueue>> _queues;
+  std::vector<std::thread> _workers;
+  std::atomic<size_t> _next_queue;
+  std::atomic<size_t> _pending_tasks;
+  std::atomic<bool> _is_stopped;
+
+  std::mutex _sleep_mutex;
+  std::condition_variable _task_submitted;
+
+  size_t currentQueue() const;
+
+  bool tryRunTask(size_t queue_index);
+
+  void work(size_t queue_index);
+};
+
+} // namespace detection
+
+#endif //THREAD_POOL_H
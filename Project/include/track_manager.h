@@ -0,0 +1,136 @@
+#ifndef TRACK_MANAGER_H
+#define TRACK_MANAGER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+#include "face_recognition_model.h"
+
+namespace {
+
+// in frames, zero recognises every detected face
+const uint32_t DEFAULT_TRACK_REVERIFY_INTERVAL = 50;
+// weight the accumulated votes keep with every new observation
+const double DEFAULT_TRACK_EVIDENCE_DECAY = 0.8;
+// observations a track needs before its label can be stable
+const uint32_t DEFAULT_TRACK_MIN_OBSERVATIONS = 2;
+// part of the accumulated votes the label needs to be stable
+const double DEFAULT_TRACK_MIN_SHARE = 0.7;
+
+} // namespace
+
+namespace detection {
+
+/**
+ * Decides labels of tracked faces from the evidence
+ * accumulated over all the keyframes of the track.
+ *
+ * Every recognition adds the votes of the model to the track,
+ * older votes fade out with every new observation. The label
+ * is the one with the most votes, so a single doubtful frame
+ * does not flip it. Once a track has been observed enough times
+ * and its label holds most of the votes, the label is stable and
+ * the track skips recognition until the re-verification interval
+ * runs out. Unknown faces are never stable and are always
+ * recognised again.
+ */
+class TrackManager {
+public:
+  struct Parameters {
+  public:
+    uint32_t reverify_interval;
+    double evidence_decay;
+    uint32_t min_observations;
+    double min_share;
+
+    Parameters(uint32_t reverify_interval = DEFAULT_TRACK_REVERIFY_INTERVAL,
+               double evidence_decay = DEFAULT_TRACK_EVIDENCE_DECAY,
+               uint32_t min_observations = DEFAULT_TRACK_MIN_OBSERVATIONS,
+               double min_share = DEFAULT_TRACK_MIN_SHARE);
+    Parameters(const Parameters& that);
+    Parameters& operator=(const Parameters& that);
+
+    ~Parameters() = default;
+  };
+
+  struct Decision {
+  public:
+    int label;
+    // average score of the recent observations,
+    // NaN if the model cannot estimate its confidence
+    double score;
+    // part of the accumulated votes behind the label
+    double share;
+    bool is_stable;
+  };
+
+  struct Stats {
+  public:
+    // faces that went to the recognition model
+    uint64_t recognised;
+    // faces of stable tracks that skipped it
+    uint64_t reused;
+  };
+
+  explicit TrackManager(const Parameters& parameters = Parameters());
+  TrackManager(const TrackManager& that);
+  TrackManager& operator=(const TrackManager& that);
+
+  /**
+   * Starts a keyframe with the tracks of its faces. Forgets tracks
+   * that are gone and returns indices of the faces to recognise.
+   */
+  std::vector<size_t> select(uint32_t frame_id,
+                             const std::vector<uint64_t>& track_ids);
+
+  /**
+   * Adds the evidence of a fresh recognition to the track.
+   */
+  void observe(uint64_t track_id,
+               uint32_t frame_id,
+               const RecognitionEvidence& evidence);
+
+  /**
+   * The label of the track, unknown for tracks
+   * that have not been observed yet.
+   */
+  Decision decide(uint64_t track_id) const;
+
+  /**
+   * Forgets all the tracks, used when a new shot starts.
+   */
+  void reset();
+
+  Stats stats() const;
+
+  ~TrackManager() = default;
+
+private:
+  struct Track {
+  public:
+    // labels are ordered, so the smallest one wins a tie
+    std::map<int, double> votes;
+    double votes_weight;
+    double scores_sum;
+    double scores_weight;
+    uint32_t observations;
+    uint32_t verified_frame;
+
+    Track();
+
+    ~Track() = default;
+  };
+
+  Parameters _parameters;
+  std::unordered_map<uint64_t, Track> _tracks;
+  Stats _stats;
+
+  Decision decide(const Track& track) const;
+};
+
+} // namespace detection
+
+#endif //TRACK_MANAGER_H
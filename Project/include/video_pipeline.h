@@ -0,0 +1,168 @@
+#ifndef VIDEO_PIPELINE_H
+#define VIDEO_PIPELINE_H
+
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "face_detection_model.h"
+#include "face_recognition_model.h"
+#include "face_tracking_model.h"
+#include "keyframe_scheduler.h"
+#include "rect.h"
+#include "scene_cut_detector.h"
+#include "spsc_queue.h"
+#include "track_manager.h"
+#include "video_player.h"
+
+namespace {
+
+// in keyframes, the whole frame is scanned for new faces at least
+// this often, other keyframes only search around tracked faces
+const uint32_t DEFAULT_FULL_SCAN_INTERVAL = 4;
+
+} // namespace
+
+namespace detection {
+
+/**
+ * Everything the pipeline knows about one frame.
+ * Stages fill the frame step by step while it flows
+ * from the decoder to the sink.
+ */
+struct PipelineFrame {
+public:
+  uint32_t id;
+  cv::Mat image;
+  // the frame starts a new shot
+  bool is_scene_cut;
+  bool is_keyframe;
+  // detected faces, keyframes only
+  std::vector<Face> faces;
+  // detected or tracked faces, empty rect
+  // stands for a face that is not tracked anymore
+  std::vector<Rect> faces_origins;
+  // stable ids of the tracks the faces belong to
+  std::vector<uint64_t> track_ids;
+  std::vector<int> labels_ids;
+  std::vector<double> scores;
+
+  PipelineFrame();
+
+  /**
+   * Forgets everything about the frame but keeps
+   * its memory, so the frame can be decoded again.
+   */
+  void clear();
+
+  ~PipelineFrame() = default;
+};
+
+/**
+ * Multi-stage video processing engine:
+ * decode -> find scene cuts -> localise (detect or track) -> recognise -> sink.
+ *
+ * Every stage runs on its own thread and stages are connected
+ * with bounded lock-free queues, therefore recognition of a keyframe
+ * overlaps with tracking of the frames that follow it.
+ * The sink runs on the thread that called {@code run} and receives
+ * frames strictly in the playback order. Frames go back to the decoder
+ * after the sink, so their images are decoded into the same memory.
+ *
+ * The keyframe scheduler decides which frames go to the detector,
+ * the rest of the frames only track faces of the latest keyframe.
+ * Scene cuts always start a new keyframe with fresh tracks
+ * and drop the evidence gathered in the previous shot.
+ *
+ * Keyframes of a shot with well tracked faces are only searched
+ * around the tracked faces, the whole frame is scanned on scene cuts,
+ * when a face has been lost and once in a few keyframes to find
+ * faces that have just entered the frame.
+ *
+ * Tracked frames reuse labels of the latest keyframe,
+ * labels are matched to faces by their index. Keyframe labels
+ * are decided by the track manager from the evidence of the whole
+ * track, faces of stable tracks skip the recognition model.
+ */
+class VideoPipeline {
+public:
+  typedef std::function<void(PipelineFrame& frame)> Sink;
+
+  struct Stats {
+  public:
+    // keyframes searched as a whole
+    uint64_t full_scans;
+    // keyframes searched around the tracked faces only
+    uint64_t roi_scans;
+  };
+
+  VideoPipeline(VideoPlayer& video_player,
+                FaceDetectionModel& face_detection,
+                FaceTrackingModel& face_tracking,
+                const FaceRecognitionModel& recognizer,
+                TrackManager& track_manager,
+                KeyframeScheduler& keyframe_scheduler,
+                SceneCutDetector& scene_cut_detector,
+                uint32_t full_scan_interval = DEFAULT_FULL_SCAN_INTERVAL,
+                size_t queue_capacity = 16);
+  VideoPipeline(const VideoPipeline& that) = delete;
+  VideoPipeline& operator=(const VideoPipeline& that) = delete;
+
+  /**
+   * Plays the whole video through the pipeline.
+   * Rethrows the first exception thrown by any stage.
+   */
+  void run(const Sink& sink);
+
+  Stats stats() const;
+
+  ~VideoPipeline() = default;
+
+private:
+  typedef std::unique_ptr<PipelineFrame> FramePtr;
+
+  VideoPlayer& _video_player;
+  FaceDetectionModel& _face_detection;
+  FaceTrackingModel& _face_tracking;
+  const FaceRecognitionModel& _recognizer;
+  TrackManager& _track_manager;
+  KeyframeScheduler& _keyframe_scheduler;
+  SceneCutDetector& _scene_cut_detector;
+  uint32_t _full_scan_interval;
+  size_t _queue_capacity;
+
+  Stats _stats;
+
+  std::mutex _error_mutex;
+  std::exception_ptr _error;
+
+  void decode(SpscQueue<FramePtr>& recycled,
+              SpscQueue<FramePtr>& output);
+  void detectSceneCuts(SpscQueue<FramePtr>& input,
+                       SpscQueue<FramePtr>& output);
+  void localise(SpscQueue<FramePtr>& input,
+                SpscQueue<FramePtr>& output);
+  void recognise(SpscQueue<FramePtr>& input,
+                 SpscQueue<FramePtr>& output);
+
+  /**
+   * Finds faces of the keyframe, tracked origins
+   * come from the previous frame.
+   */
+  std::vector<Face> detect(PipelineFrame& frame,
+                           const std::vector<Rect>& tracked_origins,
+                           uint32_t& keyframes_since_full_scan,
+                           bool& out_is_full_scan);
+
+  void fail(std::exception_ptr error);
+};
+
+} // namespace detection
+
+#endif //VIDEO_PIPELINE_H
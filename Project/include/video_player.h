@@ -1,30 +1,57 @@
 #ifndef VIDEO_PLAYER_H
 #define VIDEO_PLAYER_H
 
+#include <condition_variable>
 #include <cstdint>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include <opencv2/opencv.hpp>
 
 namespace detection {
 
+/**
+ * Plays video frame by frame.
+ *
+ * If {@code prefetch_depth} is positive, frames are decoded ahead
+ * on a separate thread into a ring of {@code prefetch_depth}
+ * buffers, therefore decoding overlaps with the processing of
+ * already decoded frames. {@code nextFrame} swaps the given matrix
+ * with the decoded one, and the memory of the given matrix is
+ * reused to decode one of the next frames: do not keep other
+ * references to the pixels of a frame after requesting the next one,
+ * or pass an empty matrix to {@code nextFrame}.
+ */
 class VideoPlayer {
-private:
-  std::string _video_file;
-  cv::VideoCapture _video_capture;
-  uint32_t _current_frame;
-  uint32_t _playback_group_size;
-
 public:
   enum class PlaybackGroupState {
       STARTING_NEW_GROUP,
       PLAYING_EXISTING_GROUP
   };
 
+  struct Stats {
+  public:
+    // times the consumer waited for a frame to be decoded
+    uint64_t consumer_stalls;
+    // times the decoder waited for a free buffer
+    uint64_t decoder_stalls;
+    uint64_t decoded_frames;
+
+    Stats();
+    Stats(const Stats& that);
+    Stats& operator=(const Stats& that);
+
+    ~Stats() = default;
+  };
+
   VideoPlayer(const std::string& video_file,
-              uint32_t playback_group_size = 10);
-  VideoPlayer(const VideoPlayer& that);
-  VideoPlayer& operator=(const VideoPlayer& that);
+              uint32_t playback_group_size = 10,
+              uint32_t prefetch_depth = 0);
+  // the decoder thread cannot be shared between players
+  VideoPlayer(const VideoPlayer& that) = delete;
+  VideoPlayer& operator=(const VideoPlayer& that) = delete;
 
   bool isOpened() const;
 
@@ -35,7 +62,36 @@ public:
   bool hasNextFrame() const;
   VideoPlayer::PlaybackGroupState nextFrame(cv::Mat& frame);
 
-  ~VideoPlayer() = default;
+  Stats stats() const;
+
+  ~VideoPlayer();
+
+private:
+  std::string _video_file;
+  cv::VideoCapture _video_capture;
+  // the capture is owned by the decoder thread in the prefetching
+  // mode, therefore its properties are read only once
+  bool _is_opened;
+  size_t _frames_count;
+  uint32_t _current_frame;
+  uint32_t _playback_group_size;
+
+  uint32_t _prefetch_depth;
+  std::vector<cv::Mat> _ring;
+  // index of the oldest decoded frame
+  size_t _ring_head;
+  // number of decoded frames waiting for the consumer
+  size_t _ring_size;
+  bool _is_decoding_finished;
+  bool _is_stopped;
+  Stats _stats;
+
+  mutable std::mutex _ring_mutex;
+  std::condition_variable _frame_decoded;
+  std::condition_variable _buffer_released;
+  std::thread _decoder;
+
+  void decodeAhead();
 };
     
 } // namespace detection
@@ -1,8 +1,14 @@
+#include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <exception>
+#include <iomanip>
 #include <iostream>
 #include <memory>
+#include <random>
+#include <sstream>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <opencv2/opencv.hpp>
@@ -12,23 +18,42 @@
 #include "dnn_recognition_model.h"
 
 #include "dlib_face_detection_model.h"
+#include "dnn_face_detection_model.h"
 #include "opencv_face_detection_model.h"
 
+#include "distance_kernels.h"
+#include "exact_embedding_index.h"
+#include "hnsw_embedding_index.h"
+
 #include "args_parser.h"
 #include "annotations_tracker.h"
 #include "face_detection_model.h"
 #include "face_tracking_model.h"
 #include "face_utils.h"
 #include "file_utils.h"
+#include "keyframe_scheduler.h"
 #include "labels_resolver.h"
 #include "metrics_tracker.h"
 #include "metrics_utils.h"
+#include "model_registry.h"
+#include "results_writer.h"
+#include "scene_cut_detector.h"
 #include "strings.h"
+#include "thread_pool.h"
+#include "track_manager.h"
+#include "video_pipeline.h"
 #include "video_player.h"
 #include "rect.h"
 
 namespace {
 
+// bounds of the face size found by the calibration are widened by
+// this factor, cascades and annotators do not agree on face boxes
+const double DEFAULT_CALIBRATION_MARGIN = 1.25;
+// in pixels, tiles of the parallel dlib search
+// the detector benchmark compares with the serial one
+const uint32_t DEFAULT_BENCHMARK_DLIB_TILE_SIZE = 640;
+
 void GenerateDataset(const std::vector<std::string>& raw_files,
                      const std::string& override_output_prefix,
                      bool is_debug) {
@@ -87,11 +112,66 @@ void GenerateDataset(const std::vector<std::string>& raw_files,
     cv::destroyAllWindows();
 }
 
+detection::FaceTrackingModel::Model ParseTrackingModel(const std::string& tracking_model) {
+    if (tracking_model == "kcf") {
+        return detection::FaceTrackingModel::Model::KCF;
+    }
+
+    if (tracking_model == "mil") {
+        return detection::FaceTrackingModel::Model::MIL;
+    }
+
+    if (tracking_model == "csrt") {
+        return detection::FaceTrackingModel::Model::CSRT;
+    }
+
+    if (tracking_model == "mosse") {
+        return detection::FaceTrackingModel::Model::MOSSE;
+    }
+
+    throw std::runtime_error("Unknown tracker " + tracking_model + ", expected kcf, mil, csrt or mosse.");
+}
+
+std::unique_ptr<detection::FaceDetectionModel> CreateDetectionModel(
+        const std::string& detection_model,
+        const detection::OpenCVFaceDetectionModel::Parameters& haar_parameters,
+        const detection::DnnFaceDetectionModel::Parameters& dnn_parameters,
+        uint32_t dlib_tile_size) {
+    if (detection_model == "haar") {
+        return std::make_unique<detection::OpenCVFaceDetectionModel>(haar_parameters);
+    }
+
+    if (detection_model == "dlib") {
+        return std::make_unique<detection::DLibFaceDetectionModel>(dlib_tile_size);
+    }
+
+    if (detection_model == "dnn") {
+        return std::make_unique<detection::DnnFaceDetectionModel>(dnn_parameters);
+    }
+
+    throw std::runtime_error("Unknown detector " + detection_model + ", expected haar, dlib or dnn.");
+}
+
+detection::DnnRecognitionModel::GalleryFormat ParseGalleryFormat(const std::string& gallery_format) {
+    if (gallery_format == "binary") {
+        return detection::DnnRecognitionModel::GalleryFormat::BINARY;
+    }
+
+    if (gallery_format == "yaml") {
+        return detection::DnnRecognitionModel::GalleryFormat::YAML;
+    }
+
+    throw std::runtime_error("Unknown gallery format " + gallery_format + ", expected binary or yaml.");
+}
+
 void TrainModel(const std::string& dataset_root_folder,
                 const std::string& output_model_file,
-                const std::string& output_label_file) {
-    std::unique_ptr<detection::FaceRecognitionModel> recognizer =
-            std::make_unique<detection::DnnRecognitionModel>();
+                const std::string& output_label_file,
+                detection::DnnRecognitionModel::GalleryFormat gallery_format) {
+    auto dnn_recognizer = std::make_unique<detection::DnnRecognitionModel>();
+    dnn_recognizer->setGalleryFormat(gallery_format);
+
+    std::unique_ptr<detection::FaceRecognitionModel> recognizer = std::move(dnn_recognizer);
 
     detection::LabelsResolver labels_resolver;
 
@@ -128,6 +208,22 @@ void TrainModel(const std::string& dataset_root_folder,
     labels_resolver.write(output_label_file);
 }
 
+void ConvertModel(const std::string& input_model_file,
+                  const std::string& output_model_file,
+                  detection::DnnRecognitionModel::GalleryFormat gallery_format) {
+    detection::DnnRecognitionModel recognizer;
+
+    auto start = std::chrono::steady_clock::now();
+    recognizer.read(input_model_file);
+    auto read_time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    recognizer.setGalleryFormat(gallery_format);
+    recognizer.write(output_model_file);
+
+    std::cout << "Read " << input_model_file << " in " << read_time << " ms, "
+              << "written to " << output_model_file << std::endl;
+}
+
 void ShowConfig(const std::vector<std::string>& raw_files) {
     std::vector<std::string> files = utils::ListAllFiles(raw_files, { ".mp4" });
 
@@ -167,21 +263,249 @@ void ShowConfig(const std::vector<std::string>& raw_files) {
     cv::destroyAllWindows();
 }
 
+/**
+ * Everything one video contributes to the overall report.
+ */
+struct VideoReport {
+public:
+  std::string log;
+  detection::BinaryClassificationMatrix detection_metrics;
+  detection::MultiClassificationMatrix known_recognition_metrics;
+  detection::BinaryClassificationMatrix unknown_recognition_metrics;
+
+  explicit VideoReport(uint32_t number_of_classes):
+      log(),
+      detection_metrics(),
+      known_recognition_metrics(number_of_classes),
+      unknown_recognition_metrics() {
+      // empty on purpose
+  }
+
+  ~VideoReport() = default;
+};
+
+/**
+ * Processes one video with its own detector, tracker,
+ * and metrics tracker, the recognition model is shared
+ * and is only used for predictions.
+ */
+std::unique_ptr<VideoReport> ProcessVideoFile(const std::string& file,
+                                              const detection::FaceRecognitionModel& recognizer,
+                                              detection::LabelsResolver labels_resolver,
+                                              detection::ResultsWriter* results_writer,
+                                              uint32_t prefetch_depth,
+                                              uint32_t reverify_interval,
+                                              const detection::KeyframeScheduler::Parameters& keyframe_parameters,
+                                              detection::FaceTrackingModel::Model tracking_model,
+                                              uint32_t full_scan_interval,
+                                              const std::string& detection_model,
+                                              const detection::OpenCVFaceDetectionModel::Parameters& detector_parameters,
+                                              double detection_scale,
+                                              uint32_t dlib_tile_size,
+                                              bool test_against_annotations,
+                                              bool is_headless,
+                                              bool is_debug) {
+    std::unique_ptr<detection::FaceDetectionModel> face_detection =
+            CreateDetectionModel(detection_model, detector_parameters, detection::DnnFaceDetectionModel::Parameters(), dlib_tile_size);
+    face_detection->setDetectionScale(detection_scale);
+
+    detection::FaceTrackingModel face_tracking(tracking_model);
+
+    // labels_resolver does not have 'unknown'
+    auto report = std::make_unique<VideoReport>(labels_resolver.size());
+    std::ostringstream log;
+
+    detection::MetricsTracker metrics_tracker(labels_resolver.getLabels());
+    std::unique_ptr<detection::AnnotationsTracker> annotations_tracker;
+    detection::VideoPlayer video_player(file, 10 /* playback_group_size */, prefetch_depth);
+
+    // only initialise annotations tracker
+    // if it has been requested
+    if (test_against_annotations) {
+        annotations_tracker = detection::AnnotationsTracker::LoadForVideo(file);
+    }
+
+    if(!video_player.isOpened()) {
+        throw std::runtime_error("Cannot open " + file);
+    }
+
+    log << file << ", frames:" << video_player.framesCount() << std::endl;
+
+    detection::TrackManager::Parameters track_parameters;
+    track_parameters.reverify_interval = reverify_interval;
+    detection::TrackManager track_manager(track_parameters);
+    detection::KeyframeScheduler keyframe_scheduler(keyframe_parameters);
+    detection::SceneCutDetector scene_cut_detector;
+    detection::VideoPipeline pipeline(video_player, *face_detection, face_tracking, recognizer,
+                                      track_manager, keyframe_scheduler, scene_cut_detector,
+                                      full_scan_interval);
+
+    // the sink runs on this thread, so
+    // windows are created on the main thread
+    pipeline.run([&](detection::PipelineFrame& pipeline_frame) {
+        const auto& frame_id = pipeline_frame.id;
+        cv::Mat& frame = pipeline_frame.image;
+        const auto& detected_faces_origins = pipeline_frame.faces_origins;
+
+        std::vector<std::string> labels;
+        for (const auto& id: pipeline_frame.labels_ids) {
+            labels.push_back(labels_resolver.obtainLabelById(id));
+        }
+
+        if (!is_headless) {
+            if (pipeline_frame.is_keyframe) {
+                detection::DrawFaces(frame, pipeline_frame.faces, labels);
+            } else {
+                detection::DrawFaces(frame, detected_faces_origins, labels);
+            }
+        }
+
+        if (results_writer != nullptr) {
+            results_writer->write(file, frame_id, pipeline_frame.is_keyframe,
+                                  detected_faces_origins, labels, pipeline_frame.scores);
+        }
+
+        int window_delay = 5;
+
+        if (test_against_annotations && annotations_tracker->hasInfo(frame_id)) {
+            const auto& frame_info = annotations_tracker->describeFrame(frame_id);
+            metrics_tracker.keepTrackOf(frame_info, labels, detected_faces_origins);
+
+            if (is_debug && !is_headless) {
+                window_delay = 1000;
+                cv::putText(frame, std::AsString(frame_id), cv::Point(5, 40), cv::FONT_HERSHEY_COMPLEX, 1, cv::Scalar(255, 0, 0), 2, cv::LINE_8);
+                detection::DrawFaces(frame, frame_info.face_origins(), frame_info.labels(), cv::Scalar(255, 0, 0));
+            }
+        }
+
+        if (!is_headless) {
+            cv::imshow(file, frame);
+            cv::waitKey(window_delay);
+        }
+    });
+
+    if (prefetch_depth > 0) {
+        const auto& playback_stats = video_player.stats();
+        log << "decoded frames: " << playback_stats.decoded_frames
+            << ", waited for decoder: " << playback_stats.consumer_stalls
+            << ", decoder waited for buffers: " << playback_stats.decoder_stalls << std::endl;
+    }
+
+    const auto& keyframe_stats = keyframe_scheduler.stats();
+    log << "keyframes: " << keyframe_stats.keyframes << " of " << keyframe_stats.frames
+        << ", scene cuts: " << keyframe_stats.scene_cuts
+        << ", tracking alarms: " << keyframe_stats.tracking_alarms << std::endl;
+
+    const auto& pipeline_stats = pipeline.stats();
+    log << "full frame scans: " << pipeline_stats.full_scans
+        << ", scans around tracked faces: " << pipeline_stats.roi_scans << std::endl;
+
+    // allocations should stop growing
+    // once the buffers are warmed up
+    auto* haar_detection = dynamic_cast<detection::OpenCVFaceDetectionModel*>(face_detection.get());
+    if (haar_detection != nullptr) {
+        const auto& detection_stats = haar_detection->stats();
+        log << "detected frames: " << detection_stats.frames
+            << ", detector allocations: " << detection_stats.allocations << std::endl;
+    }
+
+    const auto& track_stats = track_manager.stats();
+    log << "recognised faces: " << track_stats.recognised
+        << ", reused from tracks: " << track_stats.reused << std::endl;
+
+    report->detection_metrics = metrics_tracker.overallDetectionMetrics();
+
+    if (test_against_annotations) {
+        report->known_recognition_metrics = metrics_tracker.overallKnownRecognitionMetrics();
+        report->unknown_recognition_metrics = metrics_tracker.overallUnknownRecognitionMetrics();
+
+        detection::PrintBinaryMatrix("detection",
+                                     report->detection_metrics,
+                                     detection::PB_TPR | detection::PB_FNR | detection::PB_FPR  | detection::PB_CONFUSION_SCORES,
+                                     log);
+        detection::PrintMulticlassMatrix("recognition for known subjects",
+                                         report->known_recognition_metrics,
+                                         detection::MB_ACCURACY,
+                                         log);
+        detection::PrintBinaryMatrix("recognition for unknown subjects",
+                                     report->unknown_recognition_metrics,
+                                     detection::PB_CONFUSION_SCORES | detection::PB_TPR | detection::PB_FNR | detection::PB_FPR,
+                                     log);
+        log << std::endl;
+    }
+
+    report->log = log.str();
+    return report;
+}
+
+std::shared_ptr<detection::EmbeddingIndex> CreateEmbeddingIndex(const std::string& index_type,
+                                                                uint32_t ef_search) {
+    if (index_type == "exact") {
+        return std::make_shared<detection::ExactEmbeddingIndex>();
+    }
+
+    if (index_type == "hnsw") {
+        detection::HnswEmbeddingIndex::Parameters parameters;
+        parameters.ef_search = ef_search;
+        return std::make_shared<detection::HnswEmbeddingIndex>(parameters);
+    }
+
+    throw std::runtime_error("Unknown index type " + index_type + ", expected exact or hnsw.");
+}
+
 void ProcessVideoFiles(const std::vector<std::string>& raw_files,
                        const std::string& input_model_file,
                        const std::string& input_label_file,
+                       const std::string& index_type,
+                       uint32_t ef_search,
+                       const std::string& results_file,
+                       uint32_t prefetch_depth,
+                       uint32_t reverify_interval,
+                       const detection::KeyframeScheduler::Parameters& keyframe_parameters,
+                       detection::FaceTrackingModel::Model tracking_model,
+                       uint32_t full_scan_interval,
+                       const std::string& detection_model,
+                       const detection::OpenCVFaceDetectionModel::Parameters& detector_parameters,
+                       double detection_scale,
+                       uint32_t dlib_tile_size,
+                       uint32_t jobs,
                        bool test_against_annotations,
+                       bool is_headless,
                        bool is_debug) {
     std::vector<std::string> files = utils::ListAllFiles(raw_files, { ".mp4" });
 
-    std::unique_ptr<detection::FaceDetectionModel> face_detection =
-            std::make_unique<detection::OpenCVFaceDetectionModel>();
+    // windows can only be used from the main thread,
+    // so parallel processing is always headless
+    if (jobs > 1) {
+        is_headless = true;
+    }
+
+    // headless mode never touches windows and reports
+    // results as json lines instead of drawing them
+    std::unique_ptr<detection::ResultsWriter> results_writer;
+    if (is_headless || !results_file.empty()) {
+        results_writer = std::make_unique<detection::ResultsWriter>(results_file);
+    }
 
-    detection::FaceTrackingModel face_tracking(detection::FaceTrackingModel::Model::KCF);
+    // json lines written to the standard output
+    // should not be interleaved with human-readable logs
+    std::ostream& log_stream = results_writer != nullptr && results_file.empty() ? std::cerr : std::cout;
 
-    std::unique_ptr<detection::FaceRecognitionModel> recognizer =
-            std::make_unique<detection::DnnRecognitionModel>();
-    recognizer->read(input_model_file);
+    auto cold_start = std::chrono::steady_clock::now();
+
+    auto dnn_recognizer = std::make_unique<detection::DnnRecognitionModel>();
+    dnn_recognizer->setEmbeddingIndex(CreateEmbeddingIndex(index_type, ef_search));
+    dnn_recognizer->read(input_model_file);
+    dnn_recognizer->waitForModels();
+
+    log_stream << "Cold start: "
+              << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - cold_start).count()
+              << " ms" << std::endl;
+    for (const auto& record: detection::ModelRegistry::shared().records()) {
+        log_stream << "  loaded " << record.file << " in " << record.milliseconds << " ms" << std::endl;
+    }
+
+    std::unique_ptr<detection::FaceRecognitionModel> recognizer = std::move(dnn_recognizer);
 
     detection::LabelsResolver labels_resolver;
     labels_resolver.read(input_label_file);
@@ -191,110 +515,494 @@ void ProcessVideoFiles(const std::vector<std::string>& raw_files,
     detection::MultiClassificationMatrix overall_known_recognition_metrics(labels_resolver.size());
     detection::BinaryClassificationMatrix overall_unknown_recognition_metrics;
 
-    for (const auto& file: files) {
-        detection::MetricsTracker metrics_tracker(labels_resolver.getLabels());
-        std::unique_ptr<detection::AnnotationsTracker> annotations_tracker;
-        detection::VideoPlayer video_player(file, 10 /* playback_group_size */);
-        cv::Mat frame;
+    std::vector<std::unique_ptr<VideoReport>> reports(files.size());
+
+    auto process_file = [&](size_t index) {
+        reports[index] = ProcessVideoFile(files[index],
+                                          *recognizer, labels_resolver,
+                                          results_writer.get(),
+                                          prefetch_depth,
+                                          reverify_interval,
+                                          keyframe_parameters,
+                                          tracking_model,
+                                          full_scan_interval,
+                                          detection_model,
+                                          detector_parameters,
+                                          detection_scale,
+                                          dlib_tile_size,
+                                          test_against_annotations,
+                                          is_headless,
+                                          is_debug);
+    };
+
+    if (jobs > 1) {
+        // this thread processes videos as well
+        // while it waits for the workers
+        detection::ThreadPool thread_pool(jobs - 1);
+        thread_pool.parallelFor(files.size(), process_file);
+    } else {
+        for (size_t i = 0; i < files.size(); i++) {
+            process_file(i);
+            log_stream << reports[i]->log;
+        }
+    }
+
+    // reports are merged in the order of files,
+    // so the totals do not depend on the scheduling
+    for (size_t i = 0; i < reports.size(); i++) {
+        const auto& report = reports[i];
+
+        if (jobs > 1) {
+            log_stream << report->log;
+        }
+
+        overall_detection_metrics += report->detection_metrics;
 
-        // only initialise annotations tracker
-        // if it has been requested
         if (test_against_annotations) {
-            annotations_tracker = detection::AnnotationsTracker::LoadForVideo(file);
+            overall_known_recognition_metrics += report->known_recognition_metrics;
+            overall_unknown_recognition_metrics += report->unknown_recognition_metrics;
         }
+    }
 
-        if(!video_player.isOpened()) {
-            throw std::runtime_error("Cannot open " + file);
+    // if there is the only video there is no reason
+    // to show overall statistics
+    if (test_against_annotations && files.size() > 1) {
+        detection::PrintBinaryMatrix("overall detection",
+                                     overall_detection_metrics,
+                                     detection::PB_TPR | detection::PB_FNR | detection::PB_FPR,
+                                     log_stream);
+        detection::PrintMulticlassMatrix("overall recognition for known subjects",
+                                         overall_known_recognition_metrics,
+                                         detection::MB_ACCURACY,
+                                         log_stream);
+        detection::PrintBinaryMatrix("overall recognition for unknown subjects",
+                                     overall_unknown_recognition_metrics,
+                                     detection::PB_TPR | detection::PB_FNR | detection::PB_FPR,
+                                     log_stream);
+    }
+
+    if (!is_headless) {
+        cv::waitKey(0);
+        cv::destroyAllWindows();
+    }
+}
+
+/**
+ * Derives bounds of the face size from the annotated faces,
+ * so the cascade skips the scales that never contain a face.
+ * Other settings are taken from the input configuration if any.
+ */
+void CalibrateDetector(const std::vector<std::string>& raw_files,
+                       const std::string& input_config_file,
+                       const std::string& output_config_file) {
+    std::vector<std::string> files = utils::ListAllFiles(raw_files, { ".mp4" });
+
+    std::vector<uint32_t> min_sides;
+    std::vector<uint32_t> max_sides;
+
+    for (const auto& file: files) {
+        std::unique_ptr<detection::AnnotationsTracker> annotations_tracker =
+                detection::AnnotationsTracker::LoadForVideo(file);
+
+        for (const auto& frame_id: annotations_tracker->annotatedFrames()) {
+            for (const auto& face_origin: annotations_tracker->describeFrame(frame_id).face_origins()) {
+                if (face_origin.empty()) {
+                    continue;
+                }
+
+                min_sides.push_back(std::min(face_origin.width, face_origin.height));
+                max_sides.push_back(std::max(face_origin.width, face_origin.height));
+            }
         }
+    }
 
-        std::cout << file << ", frames:" << video_player.framesCount() << std::endl;
+    if (min_sides.empty()) {
+        throw std::runtime_error("No annotated faces to calibrate the detector on.");
+    }
 
-        std::vector<std::string> labels;
-        std::vector<detection::Rect> detected_faces_origins;
+    detection::OpenCVFaceDetectionModel::Parameters parameters;
+    if (!input_config_file.empty()) {
+        parameters.read(input_config_file);
+    }
 
-        while (video_player.hasNextFrame()) {
-            const auto& frame_id = video_player.currentFrame();
-            const auto& playback_state = video_player.nextFrame(frame);
+    uint32_t smallest_face = *std::min_element(min_sides.begin(), min_sides.end());
+    uint32_t largest_face = *std::max_element(max_sides.begin(), max_sides.end());
+
+    parameters.min_face_size = static_cast<uint32_t>(std::floor(smallest_face / DEFAULT_CALIBRATION_MARGIN));
+    parameters.max_face_size = static_cast<uint32_t>(std::ceil(largest_face * DEFAULT_CALIBRATION_MARGIN));
+
+    parameters.write(output_config_file);
+
+    std::cout << "Annotated faces: " << min_sides.size()
+              << ", from " << smallest_face << " to " << largest_face << " px" << std::endl;
+    std::cout << "Face size bounds: from " << parameters.min_face_size
+              << " to " << parameters.max_face_size << " px" << std::endl;
+}
+
+/**
+ * Compares face trackers on annotated videos. Trackers start from
+ * the annotated faces and are checked against the next annotated
+ * frame, so detection errors do not get into the results.
+ */
+void BenchmarkTrackers(const std::vector<std::string>& raw_files,
+                       const std::vector<std::string>& tracking_models) {
+    typedef std::chrono::steady_clock Clock;
+
+    std::vector<std::string> files = utils::ListAllFiles(raw_files, { ".mp4" });
+
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "| Tracker | Resets | Init, ms | Update, ms | Mean IoU | Lost |" << std::endl;
+    std::cout << "|---------|--------|----------|------------|----------|------|" << std::endl;
 
-            if (playback_state == detection::VideoPlayer::PlaybackGroupState::STARTING_NEW_GROUP) {
-                labels.clear();
-                detected_faces_origins.clear();
+    for (const auto& tracking_model: tracking_models) {
+        detection::FaceTrackingModel face_tracking(ParseTrackingModel(tracking_model));
 
-                detection::Rect viewport(0, 0, frame.cols, frame.rows);
-                std::vector<detection::Face> faces = face_detection->extractFaces(viewport, frame);
+        size_t resets = 0;
+        size_t updates = 0;
+        double init_time = 0;
+        double update_time = 0;
 
-                for(size_t i = 0; i < faces.size(); i++) {
-                    cv::Mat face = faces[i].image;
-                    int id = recognizer->predict(face);
-                    labels.push_back(labels_resolver.obtainLabelById(id));
-                    detected_faces_origins.push_back(faces[i].origin);
+        size_t checked_faces = 0;
+        size_t lost_faces = 0;
+        double iou_sum = 0;
+
+        for (const auto& file: files) {
+            std::unique_ptr<detection::AnnotationsTracker> annotations_tracker =
+                    detection::AnnotationsTracker::LoadForVideo(file);
+            detection::VideoPlayer video_player(file, 10 /* playback_group_size */);
+            cv::Mat frame;
+
+            if (!video_player.isOpened()) {
+                throw std::runtime_error("Cannot open " + file);
+            }
+
+            bool is_tracking = false;
+            std::vector<detection::Rect> faces_origins;
+
+            while (video_player.hasNextFrame()) {
+                const auto& frame_id = video_player.currentFrame();
+                video_player.nextFrame(frame);
+
+                if (is_tracking) {
+                    faces_origins.clear();
+
+                    auto start = Clock::now();
+                    face_tracking.track(frame, faces_origins);
+                    update_time += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+                    updates += faces_origins.size();
                 }
 
-                face_tracking.resetTracking(frame, labels, detected_faces_origins);
-                detection::DrawFaces(frame, faces, labels);
-            } else {
-                detected_faces_origins.clear();
+                if (!annotations_tracker->hasInfo(frame_id)) {
+                    continue;
+                }
 
-                face_tracking.track(frame, labels, detected_faces_origins);
-                detection::DrawFaces(frame, detected_faces_origins, labels);
+                const auto& expected_origins = annotations_tracker->describeFrame(frame_id).face_origins();
+
+                if (is_tracking) {
+                    for (const auto& face_origin: faces_origins) {
+                        checked_faces += 1;
+
+                        if (face_origin.empty()) {
+                            lost_faces += 1;
+                            continue;
+                        }
+
+                        double best_iou = 0;
+                        for (const auto& expected_origin: expected_origins) {
+                            best_iou = std::max(best_iou, detection::Rect::iou(face_origin, expected_origin));
+                        }
+                        iou_sum += best_iou;
+                    }
+                }
+
+                auto start = Clock::now();
+                face_tracking.resetTracking(frame, expected_origins);
+                init_time += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+                resets += 1;
+                is_tracking = true;
             }
+        }
 
-            int window_delay = 5;
+        std::cout << "| " << tracking_model
+                  << " | " << resets
+                  << " | " << (resets > 0 ? init_time / resets : 0)
+                  << " | " << (updates > 0 ? update_time / updates : 0)
+                  << " | " << (checked_faces > 0 ? iou_sum / checked_faces : 0)
+                  << " | " << (checked_faces > 0 ? static_cast<double>(lost_faces) / checked_faces : 0)
+                  << " |" << std::endl;
+    }
+}
 
-            if (test_against_annotations && annotations_tracker->hasInfo(frame_id)) {
-                const auto& frame_info = annotations_tracker->describeFrame(frame_id);
-                metrics_tracker.keepTrackOf(frame_info, labels, detected_faces_origins);
+/**
+ * Compares face detectors on the annotated frames of the videos.
+ * Only the time spent in the detector counts towards the speed,
+ * frames go to the detector in batches of the given size.
+ * With a positive tile size, dlib is measured both serially
+ * and on tiles of that size.
+ */
+void BenchmarkDetectors(const std::vector<std::string>& raw_files,
+                        const std::vector<std::string>& detection_models,
+                        const detection::DnnFaceDetectionModel::Parameters& dnn_parameters,
+                        uint32_t dlib_tile_size,
+                        uint32_t batch_size) {
+    typedef std::chrono::steady_clock Clock;
+
+    std::vector<std::string> files = utils::ListAllFiles(raw_files, { ".mp4" });
+
+    // every row is a detector and its tile size
+    std::vector<std::pair<std::string, uint32_t>> rows;
+    for (const auto& detection_model: detection_models) {
+        rows.emplace_back(detection_model, 0);
+
+        if (detection_model == "dlib" && dlib_tile_size > 0) {
+            rows.emplace_back(detection_model, dlib_tile_size);
+        }
+    }
+
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "| Detector | Frames | FPS | Recall | Precision |" << std::endl;
+    std::cout << "|----------|--------|-----|--------|-----------|" << std::endl;
 
-                if (is_debug) {
-                    window_delay = 1000;
-                    cv::putText(frame, std::AsString(frame_id), cv::Point(5, 40), cv::FONT_HERSHEY_COMPLEX, 1, cv::Scalar(255, 0, 0), 2, cv::LINE_8);
-                    detection::DrawFaces(frame, frame_info.face_origins(), frame_info.labels(), cv::Scalar(255, 0, 0));
+    for (const auto& row: rows) {
+        const auto& detection_model = row.first;
+        const auto& tile_size = row.second;
+
+        std::unique_ptr<detection::FaceDetectionModel> face_detection =
+                CreateDetectionModel(detection_model, detection::OpenCVFaceDetectionModel::Parameters(), dnn_parameters, tile_size);
+
+        detection::BinaryClassificationMatrix detection_metrics;
+
+        size_t frames = 0;
+        double detection_time = 0;
+
+        for (const auto& file: files) {
+            std::unique_ptr<detection::AnnotationsTracker> annotations_tracker =
+                    detection::AnnotationsTracker::LoadForVideo(file);
+            detection::VideoPlayer video_player(file, 10 /* playback_group_size */);
+            cv::Mat frame;
+
+            if (!video_player.isOpened()) {
+                throw std::runtime_error("Cannot open " + file);
+            }
+
+            // frames are told apart by their ids, so every video
+            // needs its own tracker, recognition is not measured
+            // and every face is unknown
+            detection::MetricsTracker metrics_tracker({ detection::FrameInfo::UNKNOWN_LABEL });
+
+            std::vector<cv::Mat> images;
+            std::vector<detection::Rect> viewports;
+            std::vector<detection::FrameInfo> frames_info;
+
+            auto detect_batch = [&]() {
+                if (images.empty()) {
+                    return;
+                }
+
+                auto start = Clock::now();
+                const auto& batch_faces = face_detection->extractFacesBatch(viewports, images);
+                detection_time += std::chrono::duration<double>(Clock::now() - start).count();
+
+                for (size_t i = 0; i < batch_faces.size(); i++) {
+                    std::vector<detection::Rect> faces_origins;
+                    for (const auto& face: batch_faces[i]) {
+                        faces_origins.push_back(face.origin);
+                    }
+
+                    std::vector<std::string> labels(faces_origins.size(), detection::FrameInfo::UNKNOWN_LABEL);
+                    metrics_tracker.keepTrackOf(frames_info[i], labels, faces_origins);
+                }
+
+                frames += images.size();
+
+                images.clear();
+                viewports.clear();
+                frames_info.clear();
+            };
+
+            while (video_player.hasNextFrame()) {
+                const auto& frame_id = video_player.currentFrame();
+                video_player.nextFrame(frame);
+
+                if (!annotations_tracker->hasInfo(frame_id)) {
+                    continue;
+                }
+
+                // the player reuses the memory of its frames
+                images.push_back(frame.clone());
+                viewports.push_back(detection::Rect(0, 0, frame.cols, frame.rows));
+                frames_info.push_back(annotations_tracker->describeFrame(frame_id));
+
+                if (images.size() >= batch_size) {
+                    detect_batch();
                 }
             }
 
-            cv::imshow(file, frame);
-            cv::waitKey(window_delay);
+            detect_batch();
+
+            detection_metrics += metrics_tracker.overallDetectionMetrics();
         }
 
-        const auto& detection_metrics = metrics_tracker.overallDetectionMetrics();
-        overall_detection_metrics += detection_metrics;
+        std::cout << "| " << detection_model;
+        if (tile_size > 0) {
+            std::cout << ", " << tile_size << " px tiles";
+        }
 
-        if (test_against_annotations) {
-            const auto& known_recognition_metrics = metrics_tracker.overallKnownRecognitionMetrics();
-            overall_known_recognition_metrics += known_recognition_metrics;
-
-            const auto& unknown_recognition_metrics = metrics_tracker.overallUnknownRecognitionMetrics();
-            overall_unknown_recognition_metrics += unknown_recognition_metrics;
-
-            detection::PrintBinaryMatrix("detection",
-                                         detection_metrics,
-                                         detection::PB_TPR | detection::PB_FNR | detection::PB_FPR  | detection::PB_CONFUSION_SCORES);
-            detection::PrintMulticlassMatrix("recognition for known subjects",
-                                             known_recognition_metrics,
-                                             detection::MB_ACCURACY);
-            detection::PrintBinaryMatrix("recognition for unknown subjects",
-                                         unknown_recognition_metrics,
-                                         detection::PB_CONFUSION_SCORES | detection::PB_TPR | detection::PB_FNR | detection::PB_FPR);
-            std::cout << std::endl;
+        std::cout << " | " << frames
+                  << " | " << (detection_time > 0 ? frames / detection_time : 0)
+                  << " | " << detection_metrics.recall()
+                  << " | " << detection_metrics.precision()
+                  << " |" << std::endl;
+    }
+}
+
+/**
+ * Compares approximate nearest neighbours search with the exact one.
+ * Uses the gallery of the given model or a synthetic gallery
+ * of clustered embeddings if there is no model.
+ */
+void BenchmarkEmbeddingIndex(const std::string& input_model_file,
+                             uint32_t gallery_size,
+                             uint32_t queries_count,
+                             uint32_t k,
+                             const std::vector<uint32_t>& ef_values) {
+    typedef std::chrono::steady_clock Clock;
+
+    const size_t dimensions = 128;
+    // every identity in the synthetic gallery has this many photos
+    const uint32_t embeddings_per_identity = 10;
+
+    std::mt19937 random_engine(42);
+    std::normal_distribution<float> normal;
+
+    std::shared_ptr<const detection::EmbeddingGallery> gallery;
+
+    if (!input_model_file.empty()) {
+        gallery = detection::DnnRecognitionModel::ReadGallery(input_model_file);
+    } else {
+        uint32_t identities = std::max(1u, gallery_size / embeddings_per_identity);
+
+        // identities are spread over the unit sphere and
+        // photos of the same person stay close to each other,
+        // roughly like the descriptors of the dlib network
+        cv::Mat centers(static_cast<int>(identities), static_cast<int>(dimensions), CV_32F);
+        for (int row = 0; row < centers.rows; row++) {
+            for (int col = 0; col < centers.cols; col++) {
+                centers.at<float>(row, col) = normal(random_engine);
+            }
+
+            cv::Mat center = centers.row(row);
+            cv::normalize(center, center);
         }
+
+        cv::Mat embeddings(static_cast<int>(gallery_size), static_cast<int>(dimensions), CV_32F);
+        std::vector<int32_t> labels(gallery_size);
+
+        for (int row = 0; row < embeddings.rows; row++) {
+            int32_t identity = static_cast<int32_t>(row % identities);
+            labels[row] = identity;
+
+            for (int col = 0; col < embeddings.cols; col++) {
+                embeddings.at<float>(row, col) =
+                        centers.at<float>(identity, col) + 0.02f * normal(random_engine);
+            }
+        }
+
+        gallery = detection::EmbeddingGallery::FromRows(embeddings.ptr<float>(), labels.data(),
+                                                        gallery_size, dimensions);
     }
 
-    // if there is the only video there is no reason
-    // to show overall statistics
-    if (test_against_annotations && files.size() > 1) {
-        detection::PrintBinaryMatrix("overall detection",
-                                     overall_detection_metrics,
-                                     detection::PB_TPR | detection::PB_FNR | detection::PB_FPR);
-        detection::PrintMulticlassMatrix("overall recognition for known subjects",
-                                         overall_known_recognition_metrics,
-                                         detection::MB_ACCURACY);
-        detection::PrintBinaryMatrix("overall recognition for unknown subjects",
-                                     overall_unknown_recognition_metrics,
-                                     detection::PB_TPR | detection::PB_FNR | detection::PB_FPR);
+    if (gallery->size() == 0) {
+        throw std::runtime_error("Gallery is empty, nothing to benchmark.");
     }
 
-    cv::waitKey(0);
-    cv::destroyAllWindows();
+    // queries are noisy copies of the gallery embeddings,
+    // like new photos of already known people
+    std::uniform_int_distribution<size_t> gallery_row(0, gallery->size() - 1);
+    cv::Mat queries(static_cast<int>(queries_count), static_cast<int>(gallery->dimensions()), CV_32F);
+    for (int row = 0; row < queries.rows; row++) {
+        const float* source = gallery->embedding(gallery_row(random_engine));
+        float* query = queries.ptr<float>(row);
+
+        for (int col = 0; col < queries.cols; col++) {
+            query[col] = source[col] + 0.02f * normal(random_engine);
+        }
+    }
+
+    std::cout << "Gallery: " << gallery->size() << " embeddings, "
+              << queries.rows << " queries, k = " << k << std::endl;
+    std::cout << "Distance kernel: " << detection::GetSquaredDistancesKernel().name << std::endl;
+
+    auto measure_build = [&](detection::EmbeddingIndex& index) {
+        auto start = Clock::now();
+        index.build(gallery);
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    };
+
+    // returns the average latency of one query in microseconds
+    auto measure_search = [&](const detection::EmbeddingIndex& index,
+                              std::vector<std::vector<detection::Neighbour>>& out_results) {
+        out_results.resize(queries.rows);
+
+        auto start = Clock::now();
+        for (int row = 0; row < queries.rows; row++) {
+            index.search(queries.ptr<float>(row), k, out_results[row]);
+        }
+        return std::chrono::duration<double, std::micro>(Clock::now() - start).count() / queries.rows;
+    };
+
+    detection::ExactEmbeddingIndex exact_index;
+    double exact_build_time = measure_build(exact_index);
+
+    std::vector<std::vector<detection::Neighbour>> exact_results;
+    double exact_latency = measure_search(exact_index, exact_results);
+
+    detection::HnswEmbeddingIndex hnsw_index;
+    double hnsw_build_time = measure_build(hnsw_index);
+
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "| Index | ef | Build, s | Latency, us | Recall@k | Top-1 label |" << std::endl;
+    std::cout << "|-------|----|----------|-------------|----------|-------------|" << std::endl;
+    std::cout << "| exact | - | " << exact_build_time << " | " << exact_latency << " | 1.000 | 1.000 |" << std::endl;
+
+    for (const auto& ef: ef_values) {
+        hnsw_index.setEfSearch(ef);
+
+        std::vector<std::vector<detection::Neighbour>> hnsw_results;
+        double hnsw_latency = measure_search(hnsw_index, hnsw_results);
+
+        // distances identify neighbours well enough here,
+        // labels alone are shared by many embeddings
+        double recall = 0;
+        size_t same_labels = 0;
+
+        for (size_t qi = 0; qi < exact_results.size(); qi++) {
+            const auto& expected = exact_results[qi];
+            const auto& actual = hnsw_results[qi];
+
+            if (expected.empty()) {
+                continue;
+            }
+
+            float max_distance = expected.back().distance;
+            size_t found = 0;
+            for (const auto& neighbour: actual) {
+                if (neighbour.distance <= max_distance) {
+                    found += 1;
+                }
+            }
+            recall += static_cast<double>(std::min(found, expected.size())) / expected.size();
+
+            if (!actual.empty() && actual.front().label == expected.front().label) {
+                same_labels += 1;
+            }
+        }
+
+        std::cout << "| hnsw | " << ef << " | " << hnsw_build_time << " | " << hnsw_latency
+                  << " | " << recall / exact_results.size()
+                  << " | " << static_cast<double>(same_labels) / exact_results.size() << " |" << std::endl;
+    }
 }
 
 } // namespace
@@ -320,32 +1028,212 @@ int main(int argc, char* argv[]) {
             ShowConfig(files);
         } else if (args::DetectArgs(args,
                 { args::FLAG_TITLE_UNSPECIFIED, "--train", "-om", "-ol" } /* mandatory flags */,
-                { } /* optional flags */)) {
+                { "-gf" } /* optional flags */)) {
             const auto& dataset_root_folder = args::GetString(args, args::FLAG_TITLE_UNSPECIFIED);
             const auto& output_model_file = args::GetString(args, "-om");
             const auto& output_label_file = args::GetString(args, "-ol");
+            const auto& gallery_format = args::GetString(args, "-gf", "binary" /* default */);
 
             TrainModel(dataset_root_folder,
-                       output_model_file, output_label_file);
+                       output_model_file, output_label_file,
+                       ParseGalleryFormat(gallery_format));
+        } else if (args::DetectArgs(args,
+                                    { "--convert-model", "-im", "-om" } /* mandatory flags */,
+                                    { "-gf" } /* optional flags */)) {
+            const auto& input_model_file = args::GetString(args, "-im");
+            const auto& output_model_file = args::GetString(args, "-om");
+            const auto& gallery_format = args::GetString(args, "-gf", "binary" /* default */);
+
+            ConvertModel(input_model_file, output_model_file,
+                         ParseGalleryFormat(gallery_format));
         } else if (args::DetectArgs(args,
                                     { args::FLAG_TITLE_UNSPECIFIED, "--process", "-il", "-im" } /* mandatory flags */,
-                                    { "-t", "-d" } /* optional flags */)) {
+                                    { "-t", "-d", "-o", "-pd", "-rv", "-ki", "-fb", "-tr", "-fs", "-eh", "-ds", "-dc", "-db", "-dt", "--jobs", "--headless", "-ix", "-ef" } /* optional flags */)) {
             const auto& files = args::GetStringList(args, args::FLAG_TITLE_UNSPECIFIED);
             const auto& input_model_file = args::GetString(args, "-im");
             const auto& input_label_file = args::GetString(args, "-il");
+            const auto& results_file = args::GetString(args, "-o", "" /* default */);
+            const auto& prefetch_depth = args::GetInt(args, "-pd", 4 /* default */);
+            const auto& reverify_interval = args::GetInt(args, "-rv", DEFAULT_TRACK_REVERIFY_INTERVAL /* default */);
+            const auto& max_keyframe_interval = args::GetInt(args, "-ki", DEFAULT_KEYFRAME_MAX_INTERVAL /* default */);
+            const auto& frame_budget = args::GetInt(args, "-fb", 0 /* default */);
+            const auto& tracking_model = args::GetString(args, "-tr", "kcf" /* default */);
+            const auto& full_scan_interval = args::GetInt(args, "-fs", DEFAULT_FULL_SCAN_INTERVAL /* default */);
+            const auto& detection_scale = args::GetDouble(args, "-ds", DEFAULT_DETECTION_SCALE /* default */);
+            const auto& detection_model = args::GetString(args, "-db", "haar" /* default */);
+            const auto& dlib_tile_size = args::GetInt(args, "-dt", DEFAULT_DLIB_TILE_SIZE /* default */);
+
+            const auto& jobs = args::GetInt(args, "--jobs", 1 /* default */);
+
+            const auto& index_type = args::GetString(args, "-ix", "exact" /* default */);
+            const auto& ef_search = args::GetInt(args, "-ef", 64 /* default */);
+
+            if (prefetch_depth < 0) {
+                throw std::runtime_error("Prefetch depth cannot be negative.");
+            }
+
+            if (reverify_interval < 0) {
+                throw std::runtime_error("Re-verification interval cannot be negative.");
+            }
+
+            if (max_keyframe_interval < 1) {
+                throw std::runtime_error("Keyframe interval should be positive.");
+            }
+
+            if (frame_budget < 0) {
+                throw std::runtime_error("Frame budget cannot be negative.");
+            }
+
+            if (full_scan_interval < 1) {
+                throw std::runtime_error("Full scan interval should be positive.");
+            }
+
+            if (!(detection_scale > 0.0 && detection_scale <= 1.0)) {
+                throw std::runtime_error("Detection scale should be from (0, 1].");
+            }
+
+            if (dlib_tile_size < 0) {
+                throw std::runtime_error("Tile size cannot be negative.");
+            }
+
+            if (jobs < 1) {
+                throw std::runtime_error("Number of jobs should be positive.");
+            }
+
+            if (ef_search < 1) {
+                throw std::runtime_error("Search candidates number should be positive.");
+            }
 
             const auto& should_test_against_annotations = args::HasFlag(args, "-t");
+            const auto& is_headless = args::HasFlag(args, "--headless");
             const auto& is_debug = args::HasFlag(args, "-d");
 
+            detection::OpenCVFaceDetectionModel::Parameters detector_parameters;
+            if (args::HasFlag(args, "-dc")) {
+                detector_parameters.read(args::GetString(args, "-dc"));
+            }
+
+            if (args::HasFlag(args, "-eh")) {
+                detector_parameters.restrict_eyes_search = true;
+            }
+
+            // the base interval is lowered together with the maximum,
+            // so "-ki 1" detects faces on every frame
+            detection::KeyframeScheduler::Parameters keyframe_parameters;
+            keyframe_parameters.max_interval = static_cast<uint32_t>(max_keyframe_interval);
+            keyframe_parameters.base_interval = std::min(keyframe_parameters.base_interval,
+                                                         keyframe_parameters.max_interval);
+            keyframe_parameters.min_interval = std::min(keyframe_parameters.min_interval,
+                                                        keyframe_parameters.base_interval);
+            keyframe_parameters.frame_budget_ms = frame_budget;
+
             ProcessVideoFiles(files,
                               input_model_file, input_label_file,
+                              index_type, static_cast<uint32_t>(ef_search),
+                              results_file,
+                              static_cast<uint32_t>(prefetch_depth),
+                              static_cast<uint32_t>(reverify_interval),
+                              keyframe_parameters,
+                              ParseTrackingModel(tracking_model),
+                              static_cast<uint32_t>(full_scan_interval),
+                              detection_model,
+                              detector_parameters,
+                              detection_scale,
+                              static_cast<uint32_t>(dlib_tile_size),
+                              static_cast<uint32_t>(jobs),
                               should_test_against_annotations,
+                              is_headless,
                               is_debug);
+        } else if (args::DetectArgs(args,
+                                    { args::FLAG_TITLE_UNSPECIFIED, "--calibrate", "-o" } /* mandatory flags */,
+                                    { "-dc" } /* optional flags */)) {
+            const auto& files = args::GetStringList(args, args::FLAG_TITLE_UNSPECIFIED);
+            const auto& input_config_file = args::GetString(args, "-dc", "" /* default */);
+            const auto& output_config_file = args::GetString(args, "-o");
+
+            CalibrateDetector(files, input_config_file, output_config_file);
+        } else if (args::DetectArgs(args,
+                                    { args::FLAG_TITLE_UNSPECIFIED, "--benchmark-trackers" } /* mandatory flags */,
+                                    { "-tr" } /* optional flags */)) {
+            const auto& files = args::GetStringList(args, args::FLAG_TITLE_UNSPECIFIED);
+
+            std::vector<std::string> tracking_models = { "kcf", "mil", "csrt", "mosse" };
+            if (args::HasFlag(args, "-tr")) {
+                tracking_models = args::GetStringList(args, "-tr");
+            }
+
+            BenchmarkTrackers(files, tracking_models);
+        } else if (args::DetectArgs(args,
+                                    { args::FLAG_TITLE_UNSPECIFIED, "--benchmark-detectors" } /* mandatory flags */,
+                                    { "-db", "-bs", "-is", "-th", "-dt" } /* optional flags */)) {
+            const auto& files = args::GetStringList(args, args::FLAG_TITLE_UNSPECIFIED);
+            const auto& batch_size = args::GetInt(args, "-bs", 1 /* default */);
+            const auto& threads = args::GetInt(args, "-th", DEFAULT_DNN_DETECTOR_THREADS /* default */);
+            const auto& dlib_tile_size = args::GetInt(args, "-dt", DEFAULT_BENCHMARK_DLIB_TILE_SIZE /* default */);
+
+            std::vector<std::string> detection_models = { "haar", "dlib", "dnn" };
+            if (args::HasFlag(args, "-db")) {
+                detection_models = args::GetStringList(args, "-db");
+            }
+
+            detection::DnnFaceDetectionModel::Parameters dnn_parameters;
+            dnn_parameters.threads = threads;
+
+            // either one side of a square input or its width and height
+            if (args::HasFlag(args, "-is")) {
+                const auto& input_size = args::GetStringList(args, "-is");
+                if (input_size.empty() || input_size.size() > 2) {
+                    throw std::runtime_error("Input size should be one or two numbers.");
+                }
+
+                dnn_parameters.input_width = std::stoi(input_size.front());
+                dnn_parameters.input_height = std::stoi(input_size.back());
+            }
+
+            if (batch_size < 1) {
+                throw std::runtime_error("Batch size should be positive.");
+            }
+
+            if (threads < 0) {
+                throw std::runtime_error("Number of threads cannot be negative.");
+            }
+
+            if (dlib_tile_size < 0) {
+                throw std::runtime_error("Tile size cannot be negative.");
+            }
+
+            BenchmarkDetectors(files, detection_models, dnn_parameters,
+                               static_cast<uint32_t>(dlib_tile_size), static_cast<uint32_t>(batch_size));
+        } else if (args::DetectArgs(args,
+                                    { "--benchmark-index" } /* mandatory flags */,
+                                    { "-im", "-n", "-q", "-k", "-ef" } /* optional flags */)) {
+            const auto& input_model_file = args::GetString(args, "-im", "" /* default */);
+            const auto& gallery_size = args::GetInt(args, "-n", 100000 /* default */);
+            const auto& queries_count = args::GetInt(args, "-q", 1000 /* default */);
+            const auto& k = args::GetInt(args, "-k", DEFAULT_CONSIDERED_NEIGHBOURS /* default */);
+
+            std::vector<uint32_t> ef_values = { 16, 32, 64, 128, 256 };
+            if (args::HasFlag(args, "-ef")) {
+                ef_values.clear();
+                for (const auto& value: args::GetStringList(args, "-ef")) {
+                    ef_values.push_back(static_cast<uint32_t>(std::stoi(value)));
+                }
+            }
+
+            if (gallery_size < 1 || queries_count < 1 || k < 1) {
+                throw std::runtime_error("Gallery size, queries number and k should be positive.");
+            }
+
+            BenchmarkEmbeddingIndex(input_model_file,
+                                    static_cast<uint32_t>(gallery_size),
+                                    static_cast<uint32_t>(queries_count),
+                                    static_cast<uint32_t>(k),
+                                    ef_values);
         } else {
             std::cout << "Cannot find suitable command for the given flags." << std::endl;
         }
     } catch (const std::exception& e) {
-        std::cout << e.what() << std::endl;
+        std::cerr << e.what() << std::endl;
     }
 
     return 0;
@@ -1,5 +1,6 @@
 #include "annotations_tracker.h"
 
+#include <algorithm>
 #include <fstream>
 #include <unordered_set>
 
@@ -152,4 +153,14 @@ FrameInfo AnnotationsTracker::describeFrame(uint32_t frame_id) const {
     return FrameInfo();
 }
 
+std::vector<uint32_t> AnnotationsTracker::annotatedFrames() const {
+    std::vector<uint32_t> frames;
+    for (const auto& frame_info: _playback_info) {
+        frames.push_back(frame_info.first);
+    }
+
+    std::sort(frames.begin(), frames.end());
+    return frames;
+}
+
 } // namespace detection
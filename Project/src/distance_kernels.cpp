@@ -0,0 +1,140 @@
+#include "distance_kernels.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define DETECTION_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+void ComputeSquaredDistancesScalar(const float* query,
+                                   const float* rows,
+                                   size_t count,
+                                   size_t dimensions,
+                                   size_t stride,
+                                   float* out_distances) {
+    for (size_t ri = 0; ri < count; ri++) {
+        const float* row = rows + ri * stride;
+
+        float distance = 0;
+        for (size_t i = 0; i < dimensions; i++) {
+            float difference = query[i] - row[i];
+            distance += difference * difference;
+        }
+
+        out_distances[ri] = distance;
+    }
+}
+
+#ifdef DETECTION_X86_KERNELS
+
+// the vector kernels are compiled for their instruction sets
+// regardless of the compiler flags and are only called
+// after the processor has been checked to support them
+
+__attribute__((target("avx2,fma")))
+void ComputeSquaredDistancesAvx2(const float* query,
+                                 const float* rows,
+                                 size_t count,
+                                 size_t dimensions,
+                                 size_t stride,
+                                 float* out_distances) {
+    for (size_t ri = 0; ri < count; ri++) {
+        const float* row = rows + ri * stride;
+
+        // two independent accumulators hide the latency of fma
+        __m256 first_sum = _mm256_setzero_ps();
+        __m256 second_sum = _mm256_setzero_ps();
+
+        size_t i = 0;
+        for (; i + 16 <= dimensions; i += 16) {
+            __m256 first_difference = _mm256_sub_ps(_mm256_loadu_ps(query + i), _mm256_loadu_ps(row + i));
+            __m256 second_difference = _mm256_sub_ps(_mm256_loadu_ps(query + i + 8), _mm256_loadu_ps(row + i + 8));
+            first_sum = _mm256_fmadd_ps(first_difference, first_difference, first_sum);
+            second_sum = _mm256_fmadd_ps(second_difference, second_difference, second_sum);
+        }
+
+        for (; i + 8 <= dimensions; i += 8) {
+            __m256 difference = _mm256_sub_ps(_mm256_loadu_ps(query + i), _mm256_loadu_ps(row + i));
+            first_sum = _mm256_fmadd_ps(difference, difference, first_sum);
+        }
+
+        __m256 sum = _mm256_add_ps(first_sum, second_sum);
+        __m128 half_sum = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+        half_sum = _mm_add_ps(half_sum, _mm_movehl_ps(half_sum, half_sum));
+        half_sum = _mm_add_ss(half_sum, _mm_shuffle_ps(half_sum, half_sum, 0x1));
+
+        float distance = _mm_cvtss_f32(half_sum);
+        for (; i < dimensions; i++) {
+            float difference = query[i] - row[i];
+            distance += difference * difference;
+        }
+
+        out_distances[ri] = distance;
+    }
+}
+
+__attribute__((target("avx512f")))
+void ComputeSquaredDistancesAvx512(const float* query,
+                                   const float* rows,
+                                   size_t count,
+                                   size_t dimensions,
+                                   size_t stride,
+                                   float* out_distances) {
+    for (size_t ri = 0; ri < count; ri++) {
+        const float* row = rows + ri * stride;
+
+        __m512 first_sum = _mm512_setzero_ps();
+        __m512 second_sum = _mm512_setzero_ps();
+
+        size_t i = 0;
+        for (; i + 32 <= dimensions; i += 32) {
+            __m512 first_difference = _mm512_sub_ps(_mm512_loadu_ps(query + i), _mm512_loadu_ps(row + i));
+            __m512 second_difference = _mm512_sub_ps(_mm512_loadu_ps(query + i + 16), _mm512_loadu_ps(row + i + 16));
+            first_sum = _mm512_fmadd_ps(first_difference, first_difference, first_sum);
+            second_sum = _mm512_fmadd_ps(second_difference, second_difference, second_sum);
+        }
+
+        for (; i + 16 <= dimensions; i += 16) {
+            __m512 difference = _mm512_sub_ps(_mm512_loadu_ps(query + i), _mm512_loadu_ps(row + i));
+            first_sum = _mm512_fmadd_ps(difference, difference, first_sum);
+        }
+
+        float distance = _mm512_reduce_add_ps(_mm512_add_ps(first_sum, second_sum));
+        for (; i < dimensions; i++) {
+            float difference = query[i] - row[i];
+            distance += difference * difference;
+        }
+
+        out_distances[ri] = distance;
+    }
+}
+
+#endif
+
+detection::SquaredDistancesKernel SelectSquaredDistancesKernel() {
+#ifdef DETECTION_X86_KERNELS
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx512f")) {
+        return { "avx512", &ComputeSquaredDistancesAvx512 };
+    }
+
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return { "avx2", &ComputeSquaredDistancesAvx2 };
+    }
+#endif
+
+    return { "scalar", &ComputeSquaredDistancesScalar };
+}
+
+} // namespace
+
+namespace detection {
+
+const SquaredDistancesKernel& GetSquaredDistancesKernel() {
+    static const SquaredDistancesKernel kernel = SelectSquaredDistancesKernel();
+    return kernel;
+}
+
+} // namespace detection
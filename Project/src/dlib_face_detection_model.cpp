@@ -1,36 +1,129 @@
 #include "dlib_face_detection_model.h"
 
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
 #include "dlib_utils.h"
 #include "rect.h"
+#include "thread_pool.h"
+
+namespace {
+
+typedef dlib::frontal_face_detector::image_scanner_type::pyramid_type DetectorPyramid;
+
+// in pixels, side of the smallest face the detector finds,
+// it is the size of the detection window
+const double DLIB_DETECTION_WINDOW_SIZE = 80.0;
+// every level of the detector's pyramid shrinks the image this much
+const double DLIB_PYRAMID_SCALE = 5.0 / 6.0;
+
+/**
+ * Number of the finest pyramid levels whose window,
+ * in pixels of the frame, fits into the overlap.
+ */
+uint32_t CountTileLevels(uint32_t tile_overlap) {
+    uint32_t levels = 1;
+    while (DLIB_DETECTION_WINDOW_SIZE / std::pow(DLIB_PYRAMID_SCALE, levels) <= tile_overlap) {
+        levels += 1;
+    }
+
+    return levels;
+}
+
+dlib::frontal_face_detector CreateTileDetector(const dlib::frontal_face_detector& detector, uint32_t levels) {
+    auto scanner = detector.get_scanner();
+    scanner.set_max_pyramid_levels(levels);
+
+    std::vector<dlib::frontal_face_detector::feature_vector_type> weights;
+    for (unsigned long i = 0; i < detector.num_detectors(); i++) {
+        weights.push_back(detector.get_w(i));
+    }
+
+    return dlib::frontal_face_detector(scanner, detector.get_overlap_tester(), weights);
+}
+
+std::shared_ptr<detection::ObjectPool<dlib::frontal_face_detector>> CreateDetectorsPool(
+        const dlib::frontal_face_detector& prototype) {
+    return std::make_shared<detection::ObjectPool<dlib::frontal_face_detector>>(
+        0 /* capacity */,
+        [prototype]() {
+            return std::make_unique<dlib::frontal_face_detector>(prototype);
+        });
+}
+
+} // namespace
 
 namespace detection {
 
-DLibFaceDetectionModel::DLibFaceDetectionModel():
-    _detector(dlib::get_frontal_face_detector()) {
-    // empty on purpose
+DLibFaceDetectionModel::DLibFaceDetectionModel(uint32_t tile_size, uint32_t tile_overlap):
+    _detector(dlib::get_frontal_face_detector()),
+    _tile_size(tile_size),
+    _tile_overlap(tile_overlap),
+    _tile_levels(0),
+    _tile_detectors() {
+    if (tile_size == 0) {
+        return;
+    }
+
+    if (tile_overlap < DLIB_DETECTION_WINDOW_SIZE) {
+        throw std::runtime_error("Tiles should overlap by at least the detection window.");
+    }
+
+    _tile_levels = CountTileLevels(tile_overlap);
+    _tile_detectors = CreateDetectorsPool(CreateTileDetector(_detector, _tile_levels));
 }
 
 DLibFaceDetectionModel::DLibFaceDetectionModel(const DLibFaceDetectionModel& that):
-    _detector(that._detector) {
+    FaceDetectionModel(that),
+    _detector(that._detector),
+    _tile_size(that._tile_size),
+    _tile_overlap(that._tile_overlap),
+    _tile_levels(that._tile_levels),
+    _tile_detectors(that._tile_detectors) {
     // empty on purpose
 }
 
 DLibFaceDetectionModel& DLibFaceDetectionModel::operator=(const DLibFaceDetectionModel& that) {
     if (this != &that) {
+        FaceDetectionModel::operator=(that);
         this->_detector = that._detector;
+        this->_tile_size = that._tile_size;
+        this->_tile_overlap = that._tile_overlap;
+        this->_tile_levels = that._tile_levels;
+        this->_tile_detectors = that._tile_detectors;
     }
 
     return *this;
 }
 
 std::vector<Face> DLibFaceDetectionModel::extractFaces(const Rect& viewport, cv::Mat& raw_image) {
-    dlib::array2d<dlib::rgb_pixel> image = AsRGBOpenCVMatrix(raw_image);
+    return detect(viewport, raw_image, true /* should_downscale */);
+}
+
+std::vector<Face> DLibFaceDetectionModel::detect(const Rect& viewport, cv::Mat& raw_image, bool should_downscale) {
+    // frames are wrapped without copying, the buffers
+    // are only used for greyscale or downscaled input
+    thread_local cv::Mat greyscale_buffer;
+    thread_local cv::Mat downscaled_buffer;
+    cv::Mat search_image = should_downscale ? downscale(raw_image, downscaled_buffer) : raw_image;
+
+    bool is_tiled = _tile_size != 0
+                    && (static_cast<uint32_t>(search_image.cols) > _tile_size + _tile_overlap
+                        || static_cast<uint32_t>(search_image.rows) > _tile_size + _tile_overlap);
+
+    std::vector<dlib::rectangle> faces;
+    if (is_tiled) {
+        faces = detectTiled(search_image);
+    } else {
+        faces = _detector(AsDlibImage(search_image, greyscale_buffer));
+    }
 
     std::vector<Face> result_faces;
-    std::vector<dlib::rectangle> faces = _detector(image);
     for(size_t i = 0; i < faces.size(); i++) {
         const auto& face = faces[i];
-        Rect face_origin(face.left(), face.top(), (face.right() - face.left()), (face.bottom() - face.top()));
+        cv::Rect found_face(face.left(), face.top(), (face.right() - face.left()), (face.bottom() - face.top()));
+        Rect face_origin = Rect::from(should_downscale ? toFullResolution(found_face) : found_face);
 
         if (shouldClip(viewport, face_origin)) {
             continue;
@@ -38,7 +131,8 @@ std::vector<Face> DLibFaceDetectionModel::extractFaces(const Rect& viewport, cv:
 
         // dlib can detect faces that are outside the viewport
         // however opencv cannot extract such areas, therefore
-        // we need to find intersection with a viewport
+        // we need to find intersection with a viewport,
+        // faces are always cropped from the full resolution frame
         Rect face_origin_within_viewport = face_origin.intersection(viewport);
 
         cv::Mat face_area = raw_image(Rect::toCVRect(face_origin_within_viewport));
@@ -51,5 +145,134 @@ std::vector<Face> DLibFaceDetectionModel::extractFaces(const Rect& viewport, cv:
 
     return result_faces;
 }
+
+std::vector<Face> DLibFaceDetectionModel::extractFaces(const Rect& viewport,
+                                                       cv::Mat& raw_image,
+                                                       const std::vector<Rect>& rois) {
+    std::vector<Face> result_faces;
+
+    Rect frame(0, 0, raw_image.cols, raw_image.rows);
+    Rect visible_viewport = viewport.intersection(frame);
+
+    for (const auto& roi: rois) {
+        if (roi.empty()) {
+            continue;
+        }
+
+        double roi_size = std::sqrt(static_cast<double>(roi.area()));
+
+        for (const auto& region: searchRegions(visible_viewport, { roi })) {
+            cv::Mat area = raw_image(Rect::toCVRect(region));
+            Rect area_viewport(0, 0, region.width, region.height);
+
+            // regions are small already, so they are
+            // always searched at full resolution
+            for (const auto& face: detect(area_viewport, area, false /* should_downscale */)) {
+                double face_size = std::sqrt(static_cast<double>(face.origin.area()));
+                if (face_size < roi_size / DEFAULT_ROI_SIZE_TOLERANCE
+                    || face_size > roi_size * DEFAULT_ROI_SIZE_TOLERANCE) {
+                    continue;
+                }
+
+                AppendUnique(result_faces, Face(face.image, face.origin.escapeFromOldBasis(region), face.eyes));
+            }
+        }
+    }
+
+    return result_faces;
+}
     
+std::vector<dlib::rectangle> DLibFaceDetectionModel::detectTiled(const cv::Mat& image) {
+    const cv::Rect frame(0, 0, image.cols, image.rows);
+    const int margin = static_cast<int>(_tile_overlap / 2);
+
+    // cores split the frame, every tile is its core with a margin
+    // of half the overlap, so a face up to the overlap centred
+    // in the core fits into the tile as a whole
+    std::vector<cv::Rect> cores;
+    std::vector<cv::Rect> tiles;
+    for (int y = 0; y < image.rows; y += static_cast<int>(_tile_size)) {
+        for (int x = 0; x < image.cols; x += static_cast<int>(_tile_size)) {
+            cv::Rect core = cv::Rect(x, y, static_cast<int>(_tile_size), static_cast<int>(_tile_size)) & frame;
+            cores.push_back(core);
+            tiles.push_back(cv::Rect(core.x - margin, core.y - margin,
+                                     core.width + 2 * margin, core.height + 2 * margin) & frame);
+        }
+    }
+
+    // the last part is the coarse search, the others are tiles
+    std::vector<std::vector<dlib::rect_detection>> found(tiles.size() + 1);
+
+    ThreadPool::shared().parallelFor(found.size(), [&](size_t i) {
+        thread_local cv::Mat greyscale_buffer;
+
+        if (i < tiles.size()) {
+            const cv::Rect& tile = tiles[i];
+
+            {
+                auto detector = _tile_detectors->acquire();
+                (*detector)(AsDlibImage(image(tile), greyscale_buffer), found[i]);
+            }
+
+            std::vector<dlib::rect_detection> core_faces;
+            for (auto& detection: found[i]) {
+                detection.rect = dlib::translate_rect(detection.rect, tile.x, tile.y);
+
+                const dlib::point centre = dlib::center(detection.rect);
+                if (cores[i].contains(cv::Point(static_cast<int>(centre.x()), static_cast<int>(centre.y())))) {
+                    core_faces.push_back(detection);
+                }
+            }
+
+            found[i] = std::move(core_faces);
+            return;
+        }
+
+        // the same pyramid the detector builds, so the coarse
+        // levels see the same pixels as in the serial search
+        thread_local dlib::array2d<dlib::bgr_pixel> level;
+        thread_local dlib::array2d<dlib::bgr_pixel> next_level;
+        DetectorPyramid pyramid;
+
+        pyramid(AsDlibImage(image, greyscale_buffer), level);
+        for (uint32_t l = 1; l < _tile_levels; l++) {
+            pyramid(level, next_level);
+            level.swap(next_level);
+        }
+
+        // only this task uses the detector itself
+        _detector(level, found[i]);
+
+        for (auto& detection: found[i]) {
+            detection.rect = pyramid.rect_up(detection.rect, _tile_levels);
+        }
+    });
+
+    std::vector<dlib::rect_detection> candidates;
+    for (const auto& part: found) {
+        candidates.insert(candidates.end(), part.begin(), part.end());
+    }
+
+    std::sort(candidates.begin(), candidates.end(), [](const dlib::rect_detection& one,
+                                                       const dlib::rect_detection& another) {
+        return one.detection_confidence > another.detection_confidence;
+    });
+
+    // the same suppression the detector applies across its pyramid levels
+    const auto& overlap_tester = _detector.get_overlap_tester();
+
+    std::vector<dlib::rectangle> faces;
+    for (const auto& candidate: candidates) {
+        bool is_suppressed = std::any_of(faces.begin(), faces.end(), [&](const dlib::rectangle& face) {
+            return overlap_tester(face, candidate.rect);
+        });
+
+        if (!is_suppressed) {
+            faces.push_back(candidate.rect);
+        }
+    }
+
+    return faces;
+}
+
 } // namespace detection
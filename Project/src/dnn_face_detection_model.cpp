@@ -0,0 +1,172 @@
+#include "dnn_face_detection_model.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+// mean colour of the training set of the network, in BGR
+const cv::Scalar DNN_DETECTOR_MEAN(104.0, 177.0, 123.0);
+
+} // namespace
+
+namespace detection {
+
+DnnFaceDetectionModel::Parameters::Parameters(int input_width,
+                                              int input_height,
+                                              double confidence_threshold,
+                                              int threads):
+    input_width(input_width),
+    input_height(input_height),
+    confidence_threshold(confidence_threshold),
+    threads(threads) {
+    // empty on purpose
+}
+
+DnnFaceDetectionModel::Parameters::Parameters(const Parameters& that):
+    input_width(that.input_width),
+    input_height(that.input_height),
+    confidence_threshold(that.confidence_threshold),
+    threads(that.threads) {
+    // empty on purpose
+}
+
+DnnFaceDetectionModel::Parameters& DnnFaceDetectionModel::Parameters::operator=(const Parameters& that) {
+    if (this != &that) {
+        this->input_width = that.input_width;
+        this->input_height = that.input_height;
+        this->confidence_threshold = that.confidence_threshold;
+        this->threads = that.threads;
+    }
+
+    return *this;
+}
+
+DnnFaceDetectionModel::DnnFaceDetectionModel(const Parameters& parameters,
+                                             const std::string& config_file_path,
+                                             const std::string& model_file_path):
+    _parameters(parameters),
+    _net(),
+    _colour_buffers() {
+    if (parameters.input_width <= 0 || parameters.input_height <= 0) {
+        throw std::runtime_error("Network input size should be positive.");
+    }
+
+    _net = cv::dnn::readNetFromCaffe(config_file_path, model_file_path);
+    if (_net.empty()) {
+        throw std::runtime_error("Cannot load the face detection network from " + model_file_path);
+    }
+
+    _net.setPreferableBackend(cv::dnn::DNN_BACKEND_OPENCV);
+    _net.setPreferableTarget(cv::dnn::DNN_TARGET_CPU);
+
+    if (parameters.threads > 0) {
+        cv::setNumThreads(parameters.threads);
+    }
+}
+
+DnnFaceDetectionModel::DnnFaceDetectionModel(const DnnFaceDetectionModel& that):
+    FaceDetectionModel(that),
+    _parameters(that._parameters),
+    _net(that._net),
+    _colour_buffers() {
+    // empty on purpose
+}
+
+DnnFaceDetectionModel& DnnFaceDetectionModel::operator=(const DnnFaceDetectionModel& that) {
+    if (this != &that) {
+        FaceDetectionModel::operator=(that);
+        this->_parameters = that._parameters;
+        this->_net = that._net;
+    }
+
+    return *this;
+}
+
+std::vector<Face> DnnFaceDetectionModel::extractFaces(const Rect& viewport, cv::Mat& image) {
+    std::vector<cv::Mat> images = { image };
+    return extractFacesBatch({ viewport }, images).front();
+}
+
+std::vector<std::vector<Face>> DnnFaceDetectionModel::extractFacesBatch(const std::vector<Rect>& viewports,
+                                                                        std::vector<cv::Mat>& images) {
+    if (viewports.size() != images.size()) {
+        throw std::runtime_error("Every image should have its viewport.");
+    }
+
+    std::vector<std::vector<Face>> result_faces(images.size());
+
+    if (images.empty()) {
+        return result_faces;
+    }
+
+    // the network takes colour frames only
+    _colour_buffers.resize(std::max(_colour_buffers.size(), images.size()));
+
+    std::vector<cv::Mat> colour_images;
+    for (size_t i = 0; i < images.size(); i++) {
+        if (images[i].channels() == 1) {
+            cv::cvtColor(images[i], _colour_buffers[i], cv::COLOR_GRAY2BGR);
+            colour_images.push_back(_colour_buffers[i]);
+        } else {
+            colour_images.push_back(images[i]);
+        }
+    }
+
+    cv::Mat blob = cv::dnn::blobFromImages(colour_images,
+                                           1.0 /* scale */,
+                                           cv::Size(_parameters.input_width, _parameters.input_height),
+                                           DNN_DETECTOR_MEAN,
+                                           false /* swap_rb */,
+                                           false /* crop */);
+    _net.setInput(blob);
+    cv::Mat output = _net.forward();
+
+    // detections of all the frames come in one list of rows:
+    // [frame index, class, confidence, left, top, right, bottom],
+    // coordinates are relative to the size of the frame
+    cv::Mat detections(output.size[2], output.size[3], CV_32F, output.ptr<float>());
+
+    for (int row = 0; row < detections.rows; row++) {
+        const float* detection = detections.ptr<float>(row);
+
+        int index = static_cast<int>(detection[0]);
+        double confidence = detection[2];
+
+        if (index < 0 || index >= static_cast<int>(images.size())
+            || confidence < _parameters.confidence_threshold) {
+            continue;
+        }
+
+        cv::Mat& image = images[index];
+        const Rect& viewport = viewports[index];
+
+        int left = static_cast<int>(detection[3] * image.cols);
+        int top = static_cast<int>(detection[4] * image.rows);
+        int right = static_cast<int>(detection[5] * image.cols);
+        int bottom = static_cast<int>(detection[6] * image.rows);
+
+        if (right <= left || bottom <= top) {
+            continue;
+        }
+
+        Rect face_origin(left, top, static_cast<uint32_t>(right - left), static_cast<uint32_t>(bottom - top));
+
+        if (shouldClip(viewport, face_origin)) {
+            continue;
+        }
+
+        // boxes of faces at the border may leave the frame
+        Rect face_origin_within_viewport = face_origin.intersection(viewport)
+                                                      .intersection(Rect(0, 0, image.cols, image.rows));
+
+        result_faces[index].push_back(Face(
+                image(Rect::toCVRect(face_origin_within_viewport)),
+                face_origin,
+                Eyes()));
+    }
+
+    return result_faces;
+}
+
+} // namespace detection
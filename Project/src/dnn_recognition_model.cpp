@@ -1,69 +1,132 @@
 #include "dnn_recognition_model.h"
 
 #include <algorithm>
+#include <map>
 
 #include <dlib/image_processing/render_face_detections.h>
 
 #include "dlib_utils.h"
+#include "exact_embedding_index.h"
+#include "file_utils.h"
 
 namespace detection {
 
-std::vector<double> DnnRecognitionModel::extractFeatures(const cv::Mat& mat) const {
-    dlib::array2d<dlib::rgb_pixel> image = AsRGBOpenCVMatrix(mat);
-    dlib::pyramid_up(image);
+dlib::matrix<dlib::rgb_pixel> DnnRecognitionModel::extractFaceChip(const cv::Mat& mat) const {
+    // buffers are reused between calls, every thread
+    // has its own ones as predictions may run concurrently
+    thread_local cv::Mat greyscale_buffer;
+    thread_local dlib::array2d<dlib::rgb_pixel> image;
 
-    std::vector<dlib::matrix<dlib::rgb_pixel>> face_images;
-    dlib::rectangle face_rectangle(0, 0, image.nc(), image.nr());
+    dlib::pyramid_up(AsDlibImage(mat, greyscale_buffer), image, dlib::pyramid_down<2>());
 
-    std::vector<dlib::full_object_detection> faces_landmarks;
-    dlib::full_object_detection landmarks = _shape_predictor(image, face_rectangle);
-    faces_landmarks.push_back(landmarks);
+    dlib::rectangle face_rectangle(0, 0, image.nc(), image.nr());
+    // every thread gets the predictor through its own
+    // copy of the handle, as shared futures require
+    ModelRegistry::Handle<dlib::shape_predictor> shape_predictor = _shape_predictor;
+    dlib::full_object_detection landmarks = (*shape_predictor.get())(image, face_rectangle);
 
     dlib::matrix<dlib::rgb_pixel> face_image;
     dlib::extract_image_chip(image, dlib::get_face_chip_details(landmarks, 150, 0.25), face_image);
 
-    face_images.push_back(std::move(face_image));
+    return face_image;
+}
+
+cv::Mat DnnRecognitionModel::extractFeatures(const std::vector<cv::Mat>& mats) const {
+    std::vector<dlib::matrix<dlib::rgb_pixel>> face_images;
+    face_images.reserve(mats.size());
+
+    for (const auto& mat: mats) {
+        face_images.push_back(extractFaceChip(mat));
+    }
 
-    face_recognition_dnn_model model = _face_recognition_dnn_model;
-    std::vector<dlib::matrix<float, 0, 1>> face_descriptors = model(face_images);
+    std::vector<dlib::matrix<float, 0, 1>> face_descriptors;
+    {
+        // all chips go through the network at once,
+        // the network is given back to the pool right after
+        auto network = _inference_pool->acquire();
+        face_descriptors = (*network)(face_images);
+    }
 
-    std::vector<double> vector;
+    cv::Mat features(static_cast<int>(face_descriptors.size()), DEFAULT_VECTOR_SIZE, CV_32F);
     for (size_t di = 0; di < face_descriptors.size(); di++) {
-        auto& face_descriptor = face_descriptors[di];
+        const auto& face_descriptor = face_descriptors[di];
 
-        for (auto iterator = face_descriptor.begin(); iterator < face_descriptor.end(); iterator++) {
-            vector.push_back(static_cast<double>(*iterator));
+        if (face_descriptor.size() != DEFAULT_VECTOR_SIZE) {
+            throw std::runtime_error("Unexpected face descriptor size " + std::to_string(face_descriptor.size()));
         }
+
+        float* row = features.ptr<float>(static_cast<int>(di));
+        std::copy(face_descriptor.begin(), face_descriptor.end(), row);
     }
 
-    return vector;
+    return features;
+}
+
+void DnnRecognitionModel::requestModels() {
+    ModelRegistry& registry = ModelRegistry::shared();
+
+    _shape_predictor = registry.load<dlib::shape_predictor>(_landmarks_model_file, [](const std::string& file) {
+        auto shape_predictor = std::make_shared<dlib::shape_predictor>();
+        dlib::deserialize(file) >> *shape_predictor;
+        return std::shared_ptr<const dlib::shape_predictor>(shape_predictor);
+    });
+
+    // the prototype is never run itself,
+    // the pool makes copies of it on demand
+    ModelRegistry::Handle<face_recognition_dnn_model> prototype =
+            registry.load<face_recognition_dnn_model>(_dnn_model_file, [](const std::string& file) {
+        auto network = std::make_shared<face_recognition_dnn_model>();
+        dlib::deserialize(file) >> *network;
+        return std::shared_ptr<const face_recognition_dnn_model>(network);
+    });
+
+    _inference_pool = std::make_shared<ObjectPool<face_recognition_dnn_model>>(
+        _inference_contexts,
+        [prototype]() {
+            ModelRegistry::Handle<face_recognition_dnn_model> network = prototype;
+            return std::make_unique<face_recognition_dnn_model>(*network.get());
+        });
+}
+
+void DnnRecognitionModel::waitForModels() const {
+    ModelRegistry::Handle<dlib::shape_predictor> shape_predictor = _shape_predictor;
+    shape_predictor.get();
+
+    // leasing the network makes sure the prototype
+    // is loaded and the first copy is made
+    _inference_pool->acquire();
 }
 
 DnnRecognitionModel::DnnRecognitionModel(double unknown_max_distance,
                                          uint32_t considered_neighbours,
                                          const std::string& landmarks_model_file,
-                                         const std::string& dnn_model_file):
+                                         const std::string& dnn_model_file,
+                                         uint32_t inference_contexts):
     _unknown_max_distance(unknown_max_distance),
     _considered_neighbours(considered_neighbours),
+    _inference_contexts(inference_contexts),
     _dnn_model_file(dnn_model_file),
     _landmarks_model_file(landmarks_model_file),
     _shape_predictor(),
-    _face_recognition_dnn_model(),
-    _knearest(cv::ml::KNearest::create()) {
-    dlib::deserialize(landmarks_model_file) >> _shape_predictor;
-    dlib::deserialize(dnn_model_file) >> _face_recognition_dnn_model;
-    _knearest->setDefaultK(_considered_neighbours);
-    _knearest->setIsClassifier(true);
+    _inference_pool(),
+    _gallery_format(GalleryFormat::BINARY),
+    _gallery(EmbeddingGallery::FromRows(nullptr, nullptr, 0 /* count */, DEFAULT_VECTOR_SIZE)),
+    _index(std::make_shared<ExactEmbeddingIndex>()) {
+    requestModels();
+    buildIndex();
 }
 
 DnnRecognitionModel::DnnRecognitionModel(const DnnRecognitionModel& that):
     _unknown_max_distance(that._unknown_max_distance),
     _considered_neighbours(that._considered_neighbours),
+    _inference_contexts(that._inference_contexts),
     _dnn_model_file(that._dnn_model_file),
     _landmarks_model_file(that._landmarks_model_file),
     _shape_predictor(that._shape_predictor),
-    _face_recognition_dnn_model(that._face_recognition_dnn_model),
-    _knearest(that._knearest) {
+    _inference_pool(that._inference_pool),
+    _gallery_format(that._gallery_format),
+    _gallery(that._gallery),
+    _index(that._index) {
     // empty on purpose
 }
 
@@ -71,11 +134,14 @@ DnnRecognitionModel& DnnRecognitionModel::operator=(const DnnRecognitionModel& t
     if (this != &that) {
         this->_unknown_max_distance = that._unknown_max_distance;
         this->_considered_neighbours = that._considered_neighbours;
+        this->_inference_contexts = that._inference_contexts;
         this->_dnn_model_file = that._dnn_model_file;
         this->_landmarks_model_file = that._landmarks_model_file;
         this->_shape_predictor = that._shape_predictor;
-        this->_face_recognition_dnn_model = that._face_recognition_dnn_model;
-        this->_knearest = that._knearest;
+        this->_inference_pool = that._inference_pool;
+        this->_gallery_format = that._gallery_format;
+        this->_gallery = that._gallery;
+        this->_index = that._index;
     }
 
     return *this;
@@ -89,25 +155,171 @@ void DnnRecognitionModel::write(const std::string& file) {
     file_storage->write("_dnn_model_file", _dnn_model_file);
     file_storage->write("_landmarks_model_file", _landmarks_model_file);
 
-    _knearest->write(file_storage, "_knearest");
+    if (_gallery_format == GalleryFormat::BINARY) {
+        // only the name is kept, so the model and
+        // the gallery can be moved around together
+        std::string gallery_file = utils::GetFileName(file) + GALLERY_FILE_EXTENSION;
+        _gallery->write(utils::ReplaceFilenameWithExtension(file, gallery_file));
+
+        file_storage->write("_gallery_file", gallery_file);
+        return;
+    }
+
+    // the gallery is kept in the cv::ml::KNearest layout,
+    // so models written before the index was introduced
+    // and after it are interchangeable
+    cv::Ptr<cv::ml::KNearest> knearest = cv::ml::KNearest::create();
+    knearest->setDefaultK(_considered_neighbours);
+    knearest->setIsClassifier(true);
+
+    if (_gallery->size() > 0) {
+        cv::Mat samples(static_cast<int>(_gallery->size()), static_cast<int>(_gallery->dimensions()), CV_32F);
+        for (int row = 0; row < samples.rows; row++) {
+            const float* embedding = _gallery->embedding(row);
+            std::copy(embedding, embedding + _gallery->dimensions(), samples.ptr<float>(row));
+        }
+
+        cv::Mat responses(static_cast<int>(_gallery->size()), 1, CV_32S);
+        std::copy(_gallery->labels(), _gallery->labels() + _gallery->size(), responses.ptr<int32_t>());
+
+        knearest->train(samples, cv::ml::ROW_SAMPLE, responses);
+    }
+
+    knearest->write(file_storage, "_knearest");
 }
 
 void DnnRecognitionModel::read(const std::string& file) {
     cv::FileStorage file_storage(file, cv::FileStorage::READ);
 
+    if (!file_storage.isOpened()) {
+        throw std::runtime_error("Cannot open model file " + file);
+    }
+
     file_storage["_unknown_max_distance"] >> _unknown_max_distance;
 
     int considered_neighbours;
     file_storage["_considered_neighbours"] >> considered_neighbours;
     _considered_neighbours = static_cast<uint32_t>(considered_neighbours);
 
-    file_storage["_dnn_model_file"] >> _dnn_model_file;
-    file_storage["_landmarks_model_file"] >> _landmarks_model_file;
+    std::string dnn_model_file;
+    std::string landmarks_model_file;
+    file_storage["_dnn_model_file"] >> dnn_model_file;
+    file_storage["_landmarks_model_file"] >> landmarks_model_file;
+
+    // the constructor has already requested the default
+    // weights, usually the model refers to the same ones
+    if (dnn_model_file != _dnn_model_file || landmarks_model_file != _landmarks_model_file) {
+        _dnn_model_file = dnn_model_file;
+        _landmarks_model_file = landmarks_model_file;
+        requestModels();
+    }
+
+    // the gallery is read while the weights are being loaded
+    _gallery = ReadGallery(file_storage, file);
+    buildIndex();
+}
+
+std::shared_ptr<const EmbeddingGallery> DnnRecognitionModel::ReadGallery(const std::string& file) {
+    cv::FileStorage file_storage(file, cv::FileStorage::READ);
+
+    if (!file_storage.isOpened()) {
+        throw std::runtime_error("Cannot open model file " + file);
+    }
+
+    return ReadGallery(file_storage, file);
+}
+
+std::shared_ptr<const EmbeddingGallery> DnnRecognitionModel::ReadGallery(const cv::FileStorage& file_storage,
+                                                                         const std::string& file) {
+    cv::FileNode gallery_file_node = file_storage["_gallery_file"];
+
+    if (gallery_file_node.empty()) {
+        // the gallery is stored inside of the model
+        return ReadKNearestGallery(file_storage["_knearest"]);
+    }
+
+    std::string gallery_file;
+    gallery_file_node >> gallery_file;
+
+    std::shared_ptr<const EmbeddingGallery> gallery =
+            EmbeddingGallery::Map(utils::ReplaceFilenameWithExtension(file, gallery_file));
 
-    dlib::deserialize(_landmarks_model_file) >> _shape_predictor;
-    dlib::deserialize(_dnn_model_file) >> _face_recognition_dnn_model;
+    if (gallery->size() > 0 && gallery->dimensions() != DEFAULT_VECTOR_SIZE) {
+        throw std::runtime_error("Unexpected gallery layout: " + std::to_string(gallery->dimensions()) + " dimensions");
+    }
 
-    _knearest->read(file_storage["_knearest"]);
+    return gallery;
+}
+
+std::shared_ptr<const EmbeddingGallery> DnnRecognitionModel::ReadKNearestGallery(const cv::FileNode& node) {
+    cv::Mat samples;
+    cv::Mat responses;
+
+    node["samples"] >> samples;
+    node["responses"] >> responses;
+
+    if (samples.empty()) {
+        return EmbeddingGallery::FromRows(nullptr, nullptr, 0 /* count */, DEFAULT_VECTOR_SIZE);
+    }
+
+    if (samples.type() != CV_32F || samples.cols != DEFAULT_VECTOR_SIZE) {
+        throw std::runtime_error("Unexpected gallery layout: " + std::to_string(samples.cols) + " columns");
+    }
+
+    if (responses.total() != static_cast<size_t>(samples.rows)) {
+        throw std::runtime_error("Gallery samples size is not equal to labels size");
+    }
+
+    // cv::ml::KNearest keeps labels as floats
+    cv::Mat labels;
+    responses.reshape(1, 1).convertTo(labels, CV_32S);
+
+    if (!samples.isContinuous()) {
+        samples = samples.clone();
+    }
+
+    return EmbeddingGallery::FromRows(samples.ptr<float>(),
+                                      labels.ptr<int32_t>(),
+                                      static_cast<size_t>(samples.rows),
+                                      DEFAULT_VECTOR_SIZE);
+}
+
+void DnnRecognitionModel::setGalleryFormat(GalleryFormat gallery_format) {
+    _gallery_format = gallery_format;
+}
+
+void DnnRecognitionModel::setEmbeddingIndex(const std::shared_ptr<EmbeddingIndex>& index) {
+    if (!index) {
+        throw std::runtime_error("Embedding index cannot be empty.");
+    }
+
+    _index = index;
+    buildIndex();
+}
+
+void DnnRecognitionModel::buildIndex() {
+    _index->build(_gallery);
+}
+
+int DnnRecognitionModel::Vote(const std::vector<Neighbour>& neighbours) {
+    std::map<int32_t, size_t> votes;
+    for (const auto& neighbour: neighbours) {
+        votes[neighbour.label] += 1;
+    }
+
+    int label = FaceRecognitionModel::LABEL_UNKNOWN;
+    size_t max_votes = 0;
+
+    // labels are visited in the ascending order,
+    // so the smallest one wins a tie
+    for (const auto& vote: votes) {
+        if (vote.second > max_votes) {
+            label = vote.first;
+            max_votes = vote.second;
+        }
+    }
+
+    return label;
 }
 
 void DnnRecognitionModel::train(std::vector<cv::Mat>& images,
@@ -116,75 +328,107 @@ void DnnRecognitionModel::train(std::vector<cv::Mat>& images,
         throw std::runtime_error("Images size is not equal to labels size");
     }
 
-    cv::Mat data;
-    cv::Mat train_labels;
+    cv::Mat data(0, DEFAULT_VECTOR_SIZE, CV_32F);
+    std::vector<int32_t> train_labels;
 
     for (size_t i = 0; i < images.size(); i++) {
         cv::Mat image = images[i];
         int label = images_labels[i];
 
-        std::vector<double> features = extractFeatures(image);
-
-        cv::Mat row = cv::Mat::zeros(1, DEFAULT_VECTOR_SIZE, CV_32F);
-
-        // we were not able to detect anything in this
-        // frame
-        if (features.size() != DEFAULT_VECTOR_SIZE) {
-            continue;
-        }
-
-        for (size_t i = 0; i < features.size(); i++) {
-            row.at<float>(0, i) = static_cast<float>(features[i]);
-        }
+        cv::Mat row = extractFeatures({ image });
 
         data.push_back(row);
-        train_labels.push_back(cv::Mat(1, 1, CV_32S, label));
+        train_labels.push_back(label);
     }
 
-    cv::Ptr<cv::ml::TrainData> train_data =
-            cv::ml::TrainData::create(data, cv::ml::ROW_SAMPLE, train_labels);
-
-    _knearest->train(train_data);
+    _gallery = EmbeddingGallery::FromRows(data.ptr<float>(),
+                                          train_labels.data(),
+                                          train_labels.size(),
+                                          DEFAULT_VECTOR_SIZE);
+    buildIndex();
 }
 
 int DnnRecognitionModel::predict(cv::Mat& image) const {
-    cv::Mat train_data;
+    return predictBatch({ image })[0];
+}
+
+std::vector<int> DnnRecognitionModel::predictBatch(const std::vector<cv::Mat>& images,
+                                                   std::vector<double>& out_scores) const {
+    std::vector<int> labels;
+    labels.reserve(images.size());
 
-    std::vector<double> features = extractFeatures(image);
+    for (const auto& evidence: predictEvidence(images)) {
+        labels.push_back(evidence.label);
+        out_scores.push_back(evidence.score);
+    }
+
+    return labels;
+}
 
-    cv::Mat data = cv::Mat::zeros(1, DEFAULT_VECTOR_SIZE, CV_32F);
+std::vector<RecognitionEvidence> DnnRecognitionModel::predictEvidence(const std::vector<cv::Mat>& images) const {
+    std::vector<RecognitionEvidence> evidence;
 
-    if (features.size() != DEFAULT_VECTOR_SIZE) {
-        return FaceRecognitionModel::LABEL_UNKNOWN;
+    if (images.empty()) {
+        return evidence;
     }
 
-    for (size_t i = 0; i < DEFAULT_VECTOR_SIZE; i++) {
-        data.at<float>(0, i) = static_cast<float>(features[i]);
+    cv::Mat features = extractFeatures(images);
+
+    if (_index->size() == 0) {
+        throw std::runtime_error("Recognition model has not been trained.");
     }
 
-    train_data.push_back(data);
+    // buffer is reused between faces, every thread
+    // has its own one as predictions may run concurrently
+    thread_local std::vector<Neighbour> neighbours;
 
-    cv::Mat out_results,
-            out_neighbors,
-            out_distances;
-    float classification_result = _knearest->findNearest(train_data, _knearest->getDefaultK(), out_results, out_neighbors, out_distances);
+    evidence.resize(images.size());
 
-    double distance = 0;
-    for (size_t i = 0; i < out_distances.cols; i++) {
-        distance += out_distances.at<float>(0, i);
-    }
-    // distance is on scale from [0, 1]
-    distance /= out_distances.cols;
+    for (int row = 0; row < features.rows; row++) {
+        _index->search(features.ptr<float>(row), _considered_neighbours, neighbours);
+        RecognitionEvidence& face_evidence = evidence[row];
 
-    // let's reverse the distance and get
-    // prediction
-    double prediction = 1 - distance;
+        double distance = 0;
+        for (const auto& neighbour: neighbours) {
+            distance += neighbour.distance;
+        }
+        // distance is on scale from [0, 1]
+        distance /= neighbours.size();
 
-    if (prediction < _unknown_max_distance) {
-        return FaceRecognitionModel::LABEL_UNKNOWN;
+        // let's reverse the distance and get
+        // prediction
+        double prediction = 1 - distance;
+        face_evidence.score = prediction;
+
+        if (prediction < _unknown_max_distance) {
+            face_evidence.label = FaceRecognitionModel::LABEL_UNKNOWN;
+            face_evidence.votes.emplace_back(FaceRecognitionModel::LABEL_UNKNOWN, 1.0);
+            continue;
+        }
+
+        face_evidence.label = Vote(neighbours);
+
+        std::map<int32_t, double> similarities;
+        double total_similarity = 0;
+        for (const auto& neighbour: neighbours) {
+            double similarity = std::max(0.0, 1.0 - neighbour.distance);
+            similarities[neighbour.label] += similarity;
+            total_similarity += similarity;
+        }
+
+        // all the neighbours are as far as they can be,
+        // the decision itself is the only evidence left
+        if (total_similarity <= 0) {
+            face_evidence.votes.emplace_back(face_evidence.label, 1.0);
+            continue;
+        }
+
+        for (const auto& similarity: similarities) {
+            face_evidence.votes.emplace_back(similarity.first, similarity.second / total_similarity);
+        }
     }
 
-    return static_cast<int>(classification_result);
+    return evidence;
 }
 
 } // namespace detection
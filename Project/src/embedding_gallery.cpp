@@ -0,0 +1,276 @@
+#include "embedding_gallery.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define DETECTION_HAS_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const char GALLERY_MAGIC[8] = { 'F', 'D', 'G', 'A', 'L', 'L', 'R', 'Y' };
+// reads back as a different number on a host
+// with the other byte order
+const uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+struct GalleryHeader {
+public:
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint64_t count;
+  uint32_t dimensions;
+  uint32_t stride;
+  uint64_t labels_offset;
+  uint64_t embeddings_offset;
+  uint8_t reserved[16];
+};
+
+static_assert(sizeof(GalleryHeader) == 64, "Gallery header should take exactly 64 bytes.");
+
+size_t AlignUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+size_t RowStride(size_t dimensions) {
+    return AlignUp(dimensions, detection::EmbeddingGallery::ROW_ALIGNMENT / sizeof(float));
+}
+
+void ValidateHeader(const GalleryHeader& header, size_t file_size, const std::string& file) {
+    if (!std::equal(std::begin(GALLERY_MAGIC), std::end(GALLERY_MAGIC), std::begin(header.magic))) {
+        throw std::runtime_error(file + " is not a gallery file.");
+    }
+
+    if (header.byte_order != BYTE_ORDER_MARK) {
+        throw std::runtime_error(file + " was written on a machine with a different byte order.");
+    }
+
+    if (header.version != detection::EmbeddingGallery::FORMAT_VERSION) {
+        throw std::runtime_error(file + " has unsupported gallery version " + std::to_string(header.version));
+    }
+
+    if (header.dimensions == 0 || header.stride < header.dimensions
+        || header.stride % (detection::EmbeddingGallery::ROW_ALIGNMENT / sizeof(float)) != 0) {
+        throw std::runtime_error(file + " has invalid row layout.");
+    }
+
+    if (header.embeddings_offset % detection::EmbeddingGallery::ROW_ALIGNMENT != 0
+        || header.labels_offset % alignof(int32_t) != 0) {
+        throw std::runtime_error(file + " has misaligned sections.");
+    }
+
+    // sections are checked against the file size in a way
+    // that cannot overflow for any count read from the file
+    uint64_t labels_capacity = header.labels_offset <= file_size
+            ? (file_size - header.labels_offset) / sizeof(int32_t) : 0;
+    uint64_t rows_capacity = header.embeddings_offset <= file_size
+            ? (file_size - header.embeddings_offset) / (header.stride * sizeof(float)) : 0;
+
+    if (header.count > labels_capacity || header.count > rows_capacity) {
+        throw std::runtime_error(file + " is truncated.");
+    }
+}
+
+} // namespace
+
+namespace detection {
+
+EmbeddingGallery::EmbeddingGallery():
+    _count(0),
+    _dimensions(0),
+    _stride(0),
+    _embeddings(nullptr),
+    _labels(nullptr),
+    _embeddings_storage(),
+    _labels_storage(),
+    _mapping(nullptr),
+    _mapping_size(0) {
+    // empty on purpose
+}
+
+std::shared_ptr<const EmbeddingGallery> EmbeddingGallery::FromRows(const float* embeddings,
+                                                                   const int32_t* labels,
+                                                                   size_t count,
+                                                                   size_t dimensions) {
+    if (dimensions == 0) {
+        throw std::runtime_error("Embeddings should have at least one dimension.");
+    }
+
+    std::shared_ptr<EmbeddingGallery> gallery(new EmbeddingGallery());
+
+    gallery->_count = count;
+    gallery->_dimensions = dimensions;
+    gallery->_stride = RowStride(dimensions);
+
+    gallery->_embeddings_storage.assign(count * gallery->_stride, 0.0f);
+    for (size_t i = 0; i < count; i++) {
+        std::copy(embeddings + i * dimensions,
+                  embeddings + (i + 1) * dimensions,
+                  gallery->_embeddings_storage.begin() + i * gallery->_stride);
+    }
+    gallery->_labels_storage.assign(labels, labels + count);
+
+    gallery->_embeddings = gallery->_embeddings_storage.data();
+    gallery->_labels = gallery->_labels_storage.data();
+
+    return gallery;
+}
+
+std::shared_ptr<const EmbeddingGallery> EmbeddingGallery::Map(const std::string& file) {
+    std::shared_ptr<EmbeddingGallery> gallery(new EmbeddingGallery());
+
+    const char* data = nullptr;
+    size_t file_size = 0;
+
+#ifdef DETECTION_HAS_MMAP
+    int descriptor = ::open(file.c_str(), O_RDONLY);
+    if (descriptor < 0) {
+        throw std::runtime_error("Cannot open gallery file " + file);
+    }
+
+    struct stat file_stat;
+    if (::fstat(descriptor, &file_stat) != 0) {
+        ::close(descriptor);
+        throw std::runtime_error("Cannot read gallery file " + file);
+    }
+    file_size = static_cast<size_t>(file_stat.st_size);
+
+    if (file_size < sizeof(GalleryHeader)) {
+        ::close(descriptor);
+        throw std::runtime_error(file + " is not a gallery file.");
+    }
+
+    void* mapping = ::mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    // the mapping keeps the file alive on its own
+    ::close(descriptor);
+
+    if (mapping == MAP_FAILED) {
+        throw std::runtime_error("Cannot map gallery file " + file);
+    }
+
+    gallery->_mapping = mapping;
+    gallery->_mapping_size = file_size;
+    data = static_cast<const char*>(mapping);
+#else
+    // no mmap on this platform, the file is read
+    // into memory in one go without parsing
+    std::ifstream stream(file, std::ios::binary | std::ios::ate);
+    if (!stream) {
+        throw std::runtime_error("Cannot open gallery file " + file);
+    }
+
+    file_size = static_cast<size_t>(stream.tellg());
+    if (file_size < sizeof(GalleryHeader)) {
+        throw std::runtime_error(file + " is not a gallery file.");
+    }
+
+    // floats storage is aligned, so the sections
+    // keep their alignment inside of it
+    gallery->_embeddings_storage.resize(AlignUp(file_size, sizeof(float)) / sizeof(float));
+    stream.seekg(0);
+    stream.read(reinterpret_cast<char*>(gallery->_embeddings_storage.data()), file_size);
+    if (!stream) {
+        throw std::runtime_error("Cannot read gallery file " + file);
+    }
+    data = reinterpret_cast<const char*>(gallery->_embeddings_storage.data());
+#endif
+
+    // the header is copied out as the data
+    // is not guaranteed to be aligned for it
+    GalleryHeader header;
+    std::copy(data, data + sizeof(GalleryHeader), reinterpret_cast<char*>(&header));
+    ValidateHeader(header, file_size, file);
+
+    gallery->_count = static_cast<size_t>(header.count);
+    gallery->_dimensions = header.dimensions;
+    gallery->_stride = header.stride;
+    gallery->_labels = reinterpret_cast<const int32_t*>(data + header.labels_offset);
+    gallery->_embeddings = reinterpret_cast<const float*>(data + header.embeddings_offset);
+
+    return gallery;
+}
+
+void EmbeddingGallery::write(const std::string& file) const {
+    GalleryHeader header = {};
+
+    std::copy(std::begin(GALLERY_MAGIC), std::end(GALLERY_MAGIC), std::begin(header.magic));
+    header.version = FORMAT_VERSION;
+    header.byte_order = BYTE_ORDER_MARK;
+    header.count = _count;
+    header.dimensions = static_cast<uint32_t>(_dimensions);
+    header.stride = static_cast<uint32_t>(_stride);
+    header.labels_offset = sizeof(GalleryHeader);
+    header.embeddings_offset = AlignUp(header.labels_offset + _count * sizeof(int32_t), ROW_ALIGNMENT);
+
+    // the gallery is written aside and then moved over the file,
+    // so galleries mapped from the old file stay intact
+    const std::string temporary_file = file + ".tmp";
+
+    std::ofstream stream(temporary_file, std::ios::binary | std::ios::trunc);
+    if (!stream) {
+        throw std::runtime_error("Cannot open " + temporary_file + " for writing");
+    }
+
+    stream.write(reinterpret_cast<const char*>(&header), sizeof(GalleryHeader));
+    stream.write(reinterpret_cast<const char*>(_labels), _count * sizeof(int32_t));
+
+    std::vector<char> padding(header.embeddings_offset - header.labels_offset - _count * sizeof(int32_t), 0);
+    stream.write(padding.data(), padding.size());
+
+    // rows are written with their padding, so the file
+    // can be used as is once it is mapped
+    stream.write(reinterpret_cast<const char*>(_embeddings), _count * _stride * sizeof(float));
+
+    stream.close();
+    if (!stream) {
+        std::remove(temporary_file.c_str());
+        throw std::runtime_error("Cannot write gallery to " + temporary_file);
+    }
+
+    if (std::rename(temporary_file.c_str(), file.c_str()) != 0) {
+        std::remove(temporary_file.c_str());
+        throw std::runtime_error("Cannot replace gallery " + file);
+    }
+}
+
+size_t EmbeddingGallery::size() const {
+    return _count;
+}
+
+size_t EmbeddingGallery::dimensions() const {
+    return _dimensions;
+}
+
+size_t EmbeddingGallery::stride() const {
+    return _stride;
+}
+
+const float* EmbeddingGallery::embeddings() const {
+    return _embeddings;
+}
+
+const float* EmbeddingGallery::embedding(size_t index) const {
+    return _embeddings + index * _stride;
+}
+
+const int32_t* EmbeddingGallery::labels() const {
+    return _labels;
+}
+
+EmbeddingGallery::~EmbeddingGallery() {
+#ifdef DETECTION_HAS_MMAP
+    if (_mapping != nullptr) {
+        ::munmap(_mapping, _mapping_size);
+    }
+#endif
+}
+
+} // namespace detection
@@ -0,0 +1,102 @@
+#include "exact_embedding_index.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "distance_kernels.h"
+
+namespace {
+
+// distances are computed for this many rows at once,
+// the block stays in the first level cache
+const size_t DISTANCES_BLOCK_SIZE = 256;
+
+} // namespace
+
+namespace detection {
+
+ExactEmbeddingIndex::ExactEmbeddingIndex():
+    _gallery() {
+    // empty on purpose
+}
+
+ExactEmbeddingIndex::ExactEmbeddingIndex(const ExactEmbeddingIndex& that):
+    _gallery(that._gallery) {
+    // empty on purpose
+}
+
+ExactEmbeddingIndex& ExactEmbeddingIndex::operator=(const ExactEmbeddingIndex& that) {
+    if (this != &that) {
+        this->_gallery = that._gallery;
+    }
+
+    return *this;
+}
+
+void ExactEmbeddingIndex::build(const std::shared_ptr<const EmbeddingGallery>& gallery) {
+    _gallery = gallery;
+}
+
+size_t ExactEmbeddingIndex::size() const {
+    return _gallery ? _gallery->size() : 0;
+}
+
+size_t ExactEmbeddingIndex::dimensions() const {
+    return _gallery ? _gallery->dimensions() : 0;
+}
+
+void ExactEmbeddingIndex::search(const float* query,
+                                 size_t k,
+                                 std::vector<Neighbour>& out_neighbours) const {
+    out_neighbours.clear();
+
+    k = std::min(k, size());
+    if (k == 0) {
+        return;
+    }
+
+    const SquaredDistancesKernel& kernel = GetSquaredDistancesKernel();
+
+    // buffers are reused between calls, every thread
+    // has its own ones as searches may run concurrently
+    thread_local std::vector<float> distances;
+    // max-heap of the k closest rows seen so far,
+    // the furthest of them is on the top
+    thread_local std::vector<std::pair<float, size_t>> closest;
+
+    distances.resize(DISTANCES_BLOCK_SIZE);
+    closest.clear();
+
+    const size_t gallery_size = _gallery->size();
+    for (size_t block = 0; block < gallery_size; block += DISTANCES_BLOCK_SIZE) {
+        size_t count = std::min(DISTANCES_BLOCK_SIZE, gallery_size - block);
+        kernel.compute(query,
+                       _gallery->embedding(block),
+                       count,
+                       _gallery->dimensions(),
+                       _gallery->stride(),
+                       distances.data());
+
+        for (size_t i = 0; i < count; i++) {
+            if (closest.size() < k) {
+                closest.emplace_back(distances[i], block + i);
+                std::push_heap(closest.begin(), closest.end());
+            } else if (distances[i] < closest.front().first) {
+                // on equal distances the earlier row stays,
+                // the same way a sorted scan would keep it
+                std::pop_heap(closest.begin(), closest.end());
+                closest.back() = std::make_pair(distances[i], block + i);
+                std::push_heap(closest.begin(), closest.end());
+            }
+        }
+    }
+
+    std::sort_heap(closest.begin(), closest.end());
+
+    out_neighbours.reserve(closest.size());
+    for (const auto& row: closest) {
+        out_neighbours.emplace_back(_gallery->labels()[row.second], row.first);
+    }
+}
+
+} // namespace detection
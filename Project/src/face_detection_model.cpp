@@ -1,10 +1,71 @@
 #include "face_detection_model.h"
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <stdexcept>
 #include "face_utils.h"
 
 namespace detection {
 
+FaceDetectionModel::FaceDetectionModel(double detection_scale):
+    _detection_scale(DEFAULT_DETECTION_SCALE) {
+    setDetectionScale(detection_scale);
+}
+
+FaceDetectionModel::FaceDetectionModel(const FaceDetectionModel& that):
+    _detection_scale(that._detection_scale) {
+    // empty on purpose
+}
+
+FaceDetectionModel& FaceDetectionModel::operator=(const FaceDetectionModel& that) {
+    if (this != &that) {
+        this->_detection_scale = that._detection_scale;
+    }
+
+    return *this;
+}
+
+void FaceDetectionModel::setDetectionScale(double scale) {
+    if (!(scale > 0.0 && scale <= 1.0)) {
+        throw std::runtime_error("Detection scale should be from (0, 1].");
+    }
+
+    _detection_scale = scale;
+}
+
+double FaceDetectionModel::detectionScale() const {
+    return _detection_scale;
+}
+
+cv::Mat FaceDetectionModel::downscale(const cv::Mat& image, cv::Mat& buffer) const {
+    if (_detection_scale == 1.0) {
+        return image;
+    }
+
+    cv::Size size(std::max(1, static_cast<int>(std::lround(image.cols * _detection_scale))),
+                  std::max(1, static_cast<int>(std::lround(image.rows * _detection_scale))));
+
+    // area interpolation does not alias when shrinking and
+    // has fast vectorised paths for the integer ratios
+    cv::resize(image, buffer, size, 0, 0, cv::INTER_AREA);
+    return buffer;
+}
+
+cv::Rect FaceDetectionModel::toFullResolution(const cv::Rect& rect) const {
+    if (_detection_scale == 1.0) {
+        return rect;
+    }
+
+    // rounding outwards keeps the whole face
+    int left = static_cast<int>(std::floor(rect.x / _detection_scale));
+    int top = static_cast<int>(std::floor(rect.y / _detection_scale));
+    int right = static_cast<int>(std::ceil((rect.x + rect.width) / _detection_scale));
+    int bottom = static_cast<int>(std::ceil((rect.y + rect.height) / _detection_scale));
+
+    return cv::Rect(cv::Point(left, top), cv::Point(right, bottom));
+}
+
 bool FaceDetectionModel::shouldClip(const Rect& viewport, const Rect& face_origin) const {
     if (!face_origin.intersects(viewport)) {
         return true;
@@ -17,4 +78,75 @@ bool FaceDetectionModel::shouldClip(const Rect& viewport, const Rect& face_origi
     return visible_area < 0.3;
 }
 
+std::vector<Rect> FaceDetectionModel::searchRegions(const Rect& viewport, const std::vector<Rect>& rois) const {
+    std::vector<Rect> regions;
+
+    for (const auto& roi: rois) {
+        if (roi.empty()) {
+            continue;
+        }
+
+        double width = roi.width * DEFAULT_ROI_EXPANSION;
+        double height = roi.height * DEFAULT_ROI_EXPANSION;
+
+        Rect region(static_cast<int32_t>(roi.x + roi.width / 2.0 - width / 2),
+                    static_cast<int32_t>(roi.y + roi.height / 2.0 - height / 2),
+                    static_cast<uint32_t>(width),
+                    static_cast<uint32_t>(height));
+
+        if (!region.intersects(viewport)) {
+            continue;
+        }
+
+        regions.push_back(region.intersection(viewport));
+    }
+
+    return regions;
+}
+
+void FaceDetectionModel::AppendUnique(std::vector<Face>& faces, const Face& face) {
+    for (const auto& known_face: faces) {
+        if (Rect::iou(known_face.origin, face.origin) > 0.5) {
+            return;
+        }
+    }
+
+    faces.push_back(face);
+}
+
+std::vector<Face> FaceDetectionModel::extractFaces(const Rect& viewport,
+                                                   cv::Mat& image,
+                                                   const std::vector<Rect>& rois) {
+    std::vector<Face> result_faces;
+
+    Rect frame(0, 0, image.cols, image.rows);
+    Rect visible_viewport = viewport.intersection(frame);
+
+    for (const auto& region: searchRegions(visible_viewport, rois)) {
+        // the region is searched as a frame of its own
+        cv::Mat area = image(Rect::toCVRect(region));
+        Rect area_viewport(0, 0, region.width, region.height);
+
+        for (const auto& face: extractFaces(area_viewport, area)) {
+            AppendUnique(result_faces, Face(face.image, face.origin.escapeFromOldBasis(region), face.eyes));
+        }
+    }
+
+    return result_faces;
+}
+
+std::vector<std::vector<Face>> FaceDetectionModel::extractFacesBatch(const std::vector<Rect>& viewports,
+                                                                     std::vector<cv::Mat>& images) {
+    if (viewports.size() != images.size()) {
+        throw std::runtime_error("Every image should have its viewport.");
+    }
+
+    std::vector<std::vector<Face>> result_faces;
+    for (size_t i = 0; i < images.size(); i++) {
+        result_faces.push_back(extractFaces(viewports[i], images[i]));
+    }
+
+    return result_faces;
+}
+
 } // namespace detection
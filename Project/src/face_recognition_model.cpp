@@ -0,0 +1,53 @@
+#include "face_recognition_model.h"
+
+#include <limits>
+
+namespace detection {
+
+// containers take values by reference,
+// so the constant needs a definition
+const int FaceRecognitionModel::LABEL_UNKNOWN;
+
+RecognitionEvidence::RecognitionEvidence():
+    label(FaceRecognitionModel::LABEL_UNKNOWN),
+    score(std::numeric_limits<double>::quiet_NaN()),
+    votes() {
+    // empty on purpose
+}
+
+std::vector<int> FaceRecognitionModel::predictBatch(const std::vector<cv::Mat>& images) const {
+    std::vector<double> scores;
+    return predictBatch(images, scores);
+}
+
+std::vector<int> FaceRecognitionModel::predictBatch(const std::vector<cv::Mat>& images,
+                                                    std::vector<double>& out_scores) const {
+    std::vector<int> labels;
+    labels.reserve(images.size());
+
+    for (const auto& image: images) {
+        // predict accepts a mutable image,
+        // the header copy shares the same pixels
+        cv::Mat face = image;
+        labels.push_back(predict(face));
+        out_scores.push_back(std::numeric_limits<double>::quiet_NaN());
+    }
+
+    return labels;
+}
+
+std::vector<RecognitionEvidence> FaceRecognitionModel::predictEvidence(const std::vector<cv::Mat>& images) const {
+    std::vector<double> scores;
+    std::vector<int> labels = predictBatch(images, scores);
+
+    std::vector<RecognitionEvidence> evidence(labels.size());
+    for (size_t i = 0; i < labels.size(); i++) {
+        evidence[i].label = labels[i];
+        evidence[i].score = scores[i];
+        evidence[i].votes.emplace_back(labels[i], 1.0);
+    }
+
+    return evidence;
+}
+
+} // namespace detection
@@ -1,5 +1,12 @@
 #include "face_tracking_model.h"
 
+#include <algorithm>
+#include <cmath>
+#include <tuple>
+
+#include "mosse_tracker.h"
+#include "thread_pool.h"
+
 namespace {
 
 cv::Ptr<cv::Tracker> CreateTracker(detection::FaceTrackingModel::Model model) {
@@ -8,29 +15,72 @@ cv::Ptr<cv::Tracker> CreateTracker(detection::FaceTrackingModel::Model model) {
         case detection::FaceTrackingModel::Model::MIL: return cv::TrackerMIL::create();
         case detection::FaceTrackingModel::Model::CSRT: return cv::TrackerCSRT::create();
         case detection::FaceTrackingModel::Model::GOTURN: return cv::TrackerGOTURN::create();
+        case detection::FaceTrackingModel::Model::MOSSE: return detection::MosseTracker::create();
     }
 }
 
+// relative jump or scale change at which the confidence reaches zero
+const double MAX_RELATIVE_MOTION = 0.5;
+
+double EstimateConfidence(const cv::Rect& previous, const cv::Rect& current, const cv::Size& frame_size) {
+    if (current.empty() || previous.empty()) {
+        return 0;
+    }
+
+    double previous_size = std::sqrt(static_cast<double>(previous.area()));
+    double current_size = std::sqrt(static_cast<double>(current.area()));
+
+    double dx = (current.x + current.width / 2.0) - (previous.x + previous.width / 2.0);
+    double dy = (current.y + current.height / 2.0) - (previous.y + previous.height / 2.0);
+    double jump = std::sqrt(dx * dx + dy * dy) / previous_size;
+    double scale_change = std::abs(current_size - previous_size) / previous_size;
+
+    double motion_confidence = 1.0 - std::max(jump, scale_change) / MAX_RELATIVE_MOTION;
+
+    cv::Rect visible = current & cv::Rect(0, 0, frame_size.width, frame_size.height);
+    double visible_part = static_cast<double>(visible.area()) / current.area();
+
+    return std::max(0.0, motion_confidence) * visible_part;
+}
+
 } // namespace
 
 namespace detection {
 
-FaceTrackingModel::FaceTrackingModel(FaceTrackingModel::Model model):
+FaceTrackingModel::FaceTrackingModel(FaceTrackingModel::Model model,
+                                     double min_iou):
     _model(model),
-    _trackers() {
+    _min_iou(min_iou),
+    _trackers(),
+    _trackers_count(0),
+    _track_ids(),
+    _next_track_id(0),
+    _last_origins(),
+    _grey_frame() {
     // empty on purpose
 }
 
 FaceTrackingModel::FaceTrackingModel(const FaceTrackingModel& that):
     _model(that._model),
-    _trackers(that._trackers) {
+    _min_iou(that._min_iou),
+    _trackers(that._trackers),
+    _trackers_count(that._trackers_count),
+    _track_ids(that._track_ids),
+    _next_track_id(that._next_track_id),
+    _last_origins(that._last_origins),
+    _grey_frame() {
     // empty on purpose
 }
 
 FaceTrackingModel& FaceTrackingModel::operator=(const FaceTrackingModel& that) {
     if (this != &that) {
         this->_model = that._model;
+        this->_min_iou = that._min_iou;
         this->_trackers = that._trackers;
+        this->_trackers_count = that._trackers_count;
+        this->_track_ids = that._track_ids;
+        this->_next_track_id = that._next_track_id;
+        this->_last_origins = that._last_origins;
     }
 
     return *this;
@@ -43,36 +93,172 @@ void FaceTrackingModel::resetTracking(cv::Mat& frame,
         throw std::runtime_error("Faces and labels have different sizes.");
     }
 
-    _trackers.clear();
+    resetTracking(frame, faces_origins);
+}
+
+void FaceTrackingModel::resetTracking(cv::Mat& frame,
+                                      const std::vector<Rect>& faces_origins) {
+    const size_t faces_count = faces_origins.size();
+
+    // detections are paired with the tracks greedily,
+    // the most overlapping pairs go first
+    std::vector<std::tuple<double, size_t, size_t>> pairs;
+    for (size_t fi = 0; fi < faces_count; fi++) {
+        for (size_t ti = 0; ti < _trackers_count; ti++) {
+            double iou = Rect::iou(faces_origins[fi], Rect::from(_last_origins[ti]));
+            if (iou >= _min_iou) {
+                pairs.emplace_back(iou, fi, ti);
+            }
+        }
+    }
+
+    std::sort(pairs.begin(), pairs.end(), [](const auto& one, const auto& another) {
+        return std::get<0>(one) > std::get<0>(another);
+    });
+
+    std::vector<cv::Ptr<cv::Tracker>> trackers(faces_count);
+    std::vector<uint64_t> track_ids(faces_count);
+    std::vector<bool> is_track_matched(_trackers_count, false);
+
+    for (const auto& pair: pairs) {
+        size_t fi = std::get<1>(pair);
+        size_t ti = std::get<2>(pair);
+
+        if (trackers[fi] || is_track_matched[ti]) {
+            continue;
+        }
+
+        trackers[fi] = _trackers[ti];
+        track_ids[fi] = _track_ids[ti];
+        is_track_matched[ti] = true;
+    }
+
+    // MOSSE trackers keep their buffers and can be taken by new
+    // tracks, OpenCV trackers of the dropped tracks are destroyed
+    std::vector<cv::Ptr<cv::Tracker>> spare_trackers;
+    if (_model == FaceTrackingModel::Model::MOSSE) {
+        for (size_t ti = 0; ti < _trackers.size(); ti++) {
+            if (ti >= _trackers_count || !is_track_matched[ti]) {
+                spare_trackers.push_back(_trackers[ti]);
+            }
+        }
+    }
+
+    for (size_t fi = 0; fi < faces_count; fi++) {
+        if (trackers[fi]) {
+            continue;
+        }
+
+        if (spare_trackers.empty()) {
+            trackers[fi] = CreateTracker(_model);
+        } else {
+            trackers[fi] = spare_trackers.back();
+            spare_trackers.pop_back();
+        }
+
+        track_ids[fi] = _next_track_id;
+        _next_track_id += 1;
+    }
+
+    const cv::Mat& input = prepareFrame(frame);
 
-    for (size_t i = 0; i < faces_origins.size(); i++) {
-        const auto& face_origin = faces_origins[i];
-        const auto& label = labels[i];
+    _last_origins.clear();
+    for (size_t fi = 0; fi < faces_count; fi++) {
+        // matched trackers are seeded again with the detection,
+        // so they do not carry their drift into the next group;
+        // init of cv::Tracker and MOSSE rebuilds the whole model
+        trackers[fi]->init(input, Rect::toCVRect(faces_origins[fi]));
+        _last_origins.push_back(Rect::toCVRect(faces_origins[fi]));
+    }
 
-        cv::Ptr<cv::Tracker> tracker = CreateTracker(_model);
-        tracker->init(frame, Rect::toCVRect(face_origin));
+    _trackers = std::move(trackers);
+    _trackers.insert(_trackers.end(), spare_trackers.begin(), spare_trackers.end());
+    _trackers_count = faces_count;
+    _track_ids = std::move(track_ids);
+}
 
-        _trackers.push_back(tracker);
+void FaceTrackingModel::dropTracks() {
+    // MOSSE trackers stay as spares to reuse their buffers
+    if (_model != FaceTrackingModel::Model::MOSSE) {
+        _trackers.clear();
     }
+
+    _trackers_count = 0;
+    _track_ids.clear();
+    _last_origins.clear();
+}
+
+const std::vector<uint64_t>& FaceTrackingModel::trackIds() const {
+    return _track_ids;
+}
+
+const cv::Mat& FaceTrackingModel::prepareFrame(const cv::Mat& frame) {
+    // MOSSE works on greyscale patches, converting the frame
+    // once saves a conversion per tracked face
+    if (_model != FaceTrackingModel::Model::MOSSE || frame.channels() == 1) {
+        return frame;
+    }
+
+    cv::cvtColor(frame, _grey_frame, cv::COLOR_BGR2GRAY);
+    return _grey_frame;
 }
 
 void FaceTrackingModel::track(cv::Mat& frame,
                               std::vector<std::string>& labels,
                               std::vector<Rect>& out_faces_origins) {
-    if (labels.size() != _trackers.size()) {
+    if (labels.size() != _trackers_count) {
         throw std::runtime_error("Labels and _trackers have different sizes.");
     }
 
-    for (size_t i = 0; i < labels.size(); i++) {
-        cv::Rect out_face;
-        if (_trackers[i]->update(frame, out_face)) {
-            out_faces_origins.push_back(Rect::from(out_face));
+    track(frame, out_faces_origins);
+}
+
+void FaceTrackingModel::track(cv::Mat& frame,
+                              std::vector<Rect>& out_faces_origins) {
+    std::vector<double> confidences;
+    track(frame, out_faces_origins, confidences);
+}
+
+void FaceTrackingModel::track(cv::Mat& frame,
+                              std::vector<Rect>& out_faces_origins,
+                              std::vector<double>& out_confidences) {
+    std::vector<cv::Rect> faces(_trackers_count);
+    std::vector<double> confidences(_trackers_count, 0);
+
+    const cv::Mat& input = prepareFrame(frame);
+
+    // trackers are independent from each other, every call
+    // writes only its own slots, so the order stays stable
+    auto update = [&](size_t i) {
+        if (_trackers[i]->update(input, faces[i])) {
+            auto* mosse_tracker = dynamic_cast<MosseTracker*>(_trackers[i].get());
+
+            if (mosse_tracker != nullptr) {
+                confidences[i] = mosse_tracker->confidence();
+            } else {
+                confidences[i] = EstimateConfidence(_last_origins[i], faces[i], frame.size());
+            }
+
+            _last_origins[i] = faces[i];
         } else {
             // tracking for the given object has
             // failed, let's put empty Rect in
-            // this case
-            out_faces_origins.push_back(Rect());
+            // this case, the lost track is never
+            // matched with detections again
+            faces[i] = cv::Rect();
+            _last_origins[i] = cv::Rect();
         }
+    };
+
+    if (_trackers_count > 1) {
+        ThreadPool::shared().parallelFor(_trackers_count, update);
+    } else if (_trackers_count == 1) {
+        update(0);
+    }
+
+    for (size_t i = 0; i < _trackers_count; i++) {
+        out_faces_origins.push_back(faces[i].empty() ? Rect() : Rect::from(faces[i]));
+        out_confidences.push_back(confidences[i]);
     }
 }
 
@@ -0,0 +1,358 @@
+#include "hnsw_embedding_index.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <random>
+#include <stdexcept>
+
+#include "distance_kernels.h"
+
+namespace {
+
+/**
+ * Marks nodes visited during one search.
+ * Marks from the previous searches are invalidated
+ * by bumping the generation instead of clearing them.
+ */
+struct VisitedNodes {
+public:
+  std::vector<uint32_t> marks;
+  uint32_t generation;
+
+  VisitedNodes():
+      marks(),
+      generation(0) {
+      // empty on purpose
+  }
+
+  void reset(size_t size) {
+      if (marks.size() < size) {
+          marks.resize(size, 0);
+      }
+
+      generation += 1;
+      if (generation == 0) {
+          // generation has overflown, old marks
+          // may look like the fresh ones
+          std::fill(marks.begin(), marks.end(), 0);
+          generation = 1;
+      }
+  }
+
+  bool visit(uint32_t node) {
+      if (marks[node] == generation) {
+          return false;
+      }
+
+      marks[node] = generation;
+      return true;
+  }
+};
+
+// searches are const and can run concurrently,
+// so every thread keeps its own marks
+thread_local VisitedNodes visited_nodes;
+
+} // namespace
+
+namespace detection {
+
+HnswEmbeddingIndex::Parameters::Parameters(uint32_t m,
+                                           uint32_t ef_construction,
+                                           uint32_t ef_search,
+                                           uint32_t seed):
+    m(m),
+    ef_construction(ef_construction),
+    ef_search(ef_search),
+    seed(seed) {
+    // empty on purpose
+}
+
+HnswEmbeddingIndex::Parameters::Parameters(const Parameters& that):
+    m(that.m),
+    ef_construction(that.ef_construction),
+    ef_search(that.ef_search),
+    seed(that.seed) {
+    // empty on purpose
+}
+
+HnswEmbeddingIndex::Parameters& HnswEmbeddingIndex::Parameters::operator=(const Parameters& that) {
+    if (this != &that) {
+        this->m = that.m;
+        this->ef_construction = that.ef_construction;
+        this->ef_search = that.ef_search;
+        this->seed = that.seed;
+    }
+
+    return *this;
+}
+
+HnswEmbeddingIndex::HnswEmbeddingIndex(const Parameters& parameters):
+    _parameters(parameters),
+    _gallery(),
+    _links(),
+    _entry_point(0),
+    _top_layer(-1) {
+    if (_parameters.m < 2) {
+        throw std::runtime_error("HNSW needs at least 2 links per node.");
+    }
+}
+
+HnswEmbeddingIndex::HnswEmbeddingIndex(const HnswEmbeddingIndex& that):
+    _parameters(that._parameters),
+    _gallery(that._gallery),
+    _links(that._links),
+    _entry_point(that._entry_point),
+    _top_layer(that._top_layer) {
+    // empty on purpose
+}
+
+HnswEmbeddingIndex& HnswEmbeddingIndex::operator=(const HnswEmbeddingIndex& that) {
+    if (this != &that) {
+        this->_parameters = that._parameters;
+        this->_gallery = that._gallery;
+        this->_links = that._links;
+        this->_entry_point = that._entry_point;
+        this->_top_layer = that._top_layer;
+    }
+
+    return *this;
+}
+
+void HnswEmbeddingIndex::setEfSearch(uint32_t ef_search) {
+    _parameters.ef_search = ef_search;
+}
+
+size_t HnswEmbeddingIndex::size() const {
+    return _gallery ? _gallery->size() : 0;
+}
+
+size_t HnswEmbeddingIndex::dimensions() const {
+    return _gallery ? _gallery->dimensions() : 0;
+}
+
+float HnswEmbeddingIndex::distance(const float* query, uint32_t node) const {
+    float distance;
+    GetSquaredDistancesKernel().compute(query,
+                                        _gallery->embedding(node),
+                                        1 /* count */,
+                                        _gallery->dimensions(),
+                                        _gallery->stride(),
+                                        &distance);
+    return distance;
+}
+
+uint32_t HnswEmbeddingIndex::greedySearch(const float* query, uint32_t entry_point, int32_t layer) const {
+    uint32_t closest = entry_point;
+    float closest_distance = distance(query, closest);
+
+    bool has_moved = true;
+    while (has_moved) {
+        has_moved = false;
+
+        for (const auto& neighbour: _links[closest][layer]) {
+            float neighbour_distance = distance(query, neighbour);
+
+            if (neighbour_distance < closest_distance) {
+                closest = neighbour;
+                closest_distance = neighbour_distance;
+                has_moved = true;
+            }
+        }
+    }
+
+    return closest;
+}
+
+std::vector<HnswEmbeddingIndex::Candidate> HnswEmbeddingIndex::searchLayer(const float* query,
+                                                                          uint32_t entry_point,
+                                                                          size_t ef,
+                                                                          int32_t layer) const {
+    visited_nodes.reset(_gallery->size());
+    visited_nodes.visit(entry_point);
+
+    float entry_distance = distance(query, entry_point);
+
+    // closest candidates to expand go first
+    std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> candidates;
+    // the furthest result goes first, so it can be replaced
+    std::priority_queue<Candidate> results;
+
+    candidates.emplace(entry_distance, entry_point);
+    results.emplace(entry_distance, entry_point);
+
+    while (!candidates.empty()) {
+        Candidate current = candidates.top();
+
+        if (current.first > results.top().first && results.size() >= ef) {
+            // all the remaining candidates are further
+            // than the worst result we have
+            break;
+        }
+
+        candidates.pop();
+
+        for (const auto& neighbour: _links[current.second][layer]) {
+            if (!visited_nodes.visit(neighbour)) {
+                continue;
+            }
+
+            float neighbour_distance = distance(query, neighbour);
+
+            if (results.size() < ef || neighbour_distance < results.top().first) {
+                candidates.emplace(neighbour_distance, neighbour);
+                results.emplace(neighbour_distance, neighbour);
+
+                if (results.size() > ef) {
+                    results.pop();
+                }
+            }
+        }
+    }
+
+    std::vector<Candidate> sorted_results(results.size());
+    for (size_t i = sorted_results.size(); i > 0; i--) {
+        sorted_results[i - 1] = results.top();
+        results.pop();
+    }
+
+    return sorted_results;
+}
+
+std::vector<uint32_t> HnswEmbeddingIndex::selectNeighbours(const std::vector<Candidate>& candidates,
+                                                          size_t max_links) const {
+    std::vector<uint32_t> selected;
+    std::vector<uint32_t> pruned;
+
+    // the heuristic prefers candidates that are closer to the base
+    // node than to any already selected neighbour, so links
+    // spread in different directions instead of one dense cluster
+    for (const auto& candidate: candidates) {
+        if (selected.size() >= max_links) {
+            break;
+        }
+
+        const float* candidate_embedding = _gallery->embedding(candidate.second);
+
+        bool is_diverse = true;
+        for (const auto& neighbour: selected) {
+            if (distance(candidate_embedding, neighbour) < candidate.first) {
+                is_diverse = false;
+                break;
+            }
+        }
+
+        if (is_diverse) {
+            selected.push_back(candidate.second);
+        } else {
+            pruned.push_back(candidate.second);
+        }
+    }
+
+    // keeping pruned connections while there is still room
+    for (size_t i = 0; i < pruned.size() && selected.size() < max_links; i++) {
+        selected.push_back(pruned[i]);
+    }
+
+    return selected;
+}
+
+void HnswEmbeddingIndex::insert(uint32_t node, int32_t level) {
+    _links[node].resize(level + 1);
+
+    if (_top_layer < 0) {
+        _entry_point = node;
+        _top_layer = level;
+        return;
+    }
+
+    const float* query = _gallery->embedding(node);
+
+    uint32_t entry_point = _entry_point;
+    for (int32_t layer = _top_layer; layer > level; layer--) {
+        entry_point = greedySearch(query, entry_point, layer);
+    }
+
+    for (int32_t layer = std::min(level, _top_layer); layer >= 0; layer--) {
+        std::vector<Candidate> candidates = searchLayer(query, entry_point, _parameters.ef_construction, layer);
+        size_t max_links = layer == 0 ? 2 * _parameters.m : _parameters.m;
+
+        _links[node][layer] = selectNeighbours(candidates, _parameters.m);
+
+        for (const auto& neighbour: _links[node][layer]) {
+            auto& neighbour_links = _links[neighbour][layer];
+            neighbour_links.push_back(node);
+
+            if (neighbour_links.size() > max_links) {
+                const float* neighbour_embedding = _gallery->embedding(neighbour);
+
+                std::vector<Candidate> neighbour_candidates;
+                for (const auto& link: neighbour_links) {
+                    neighbour_candidates.emplace_back(distance(neighbour_embedding, link), link);
+                }
+                std::sort(neighbour_candidates.begin(), neighbour_candidates.end());
+
+                neighbour_links = selectNeighbours(neighbour_candidates, max_links);
+            }
+        }
+
+        entry_point = candidates.front().second;
+    }
+
+    if (level > _top_layer) {
+        _entry_point = node;
+        _top_layer = level;
+    }
+}
+
+void HnswEmbeddingIndex::build(const std::shared_ptr<const EmbeddingGallery>& gallery) {
+    const size_t count = gallery->size();
+
+    if (count > std::numeric_limits<uint32_t>::max()) {
+        throw std::runtime_error("Too many embeddings for HNSW index.");
+    }
+
+    _gallery = gallery;
+    _links.assign(count, std::vector<std::vector<uint32_t>>());
+    _entry_point = 0;
+    _top_layer = -1;
+
+    // layers are drawn from the exponential distribution,
+    // every next layer has about m times fewer nodes
+    std::mt19937 random_engine(_parameters.seed);
+    std::uniform_real_distribution<double> uniform(std::numeric_limits<double>::min(), 1.0);
+    double level_multiplier = 1.0 / std::log(static_cast<double>(_parameters.m));
+
+    for (size_t node = 0; node < count; node++) {
+        int32_t level = static_cast<int32_t>(std::floor(-std::log(uniform(random_engine)) * level_multiplier));
+        insert(static_cast<uint32_t>(node), level);
+    }
+}
+
+void HnswEmbeddingIndex::search(const float* query,
+                                size_t k,
+                                std::vector<Neighbour>& out_neighbours) const {
+    out_neighbours.clear();
+
+    if (_top_layer < 0 || k == 0) {
+        return;
+    }
+
+    uint32_t entry_point = _entry_point;
+    for (int32_t layer = _top_layer; layer > 0; layer--) {
+        entry_point = greedySearch(query, entry_point, layer);
+    }
+
+    size_t ef = std::max(static_cast<size_t>(_parameters.ef_search), k);
+    std::vector<Candidate> candidates = searchLayer(query, entry_point, ef, 0 /* layer */);
+
+    k = std::min(k, candidates.size());
+    for (size_t i = 0; i < k; i++) {
+        out_neighbours.emplace_back(_gallery->labels()[candidates[i].second], candidates[i].first);
+    }
+}
+
+} // namespace detection
@@ -0,0 +1,197 @@
+#include "keyframe_scheduler.h"
+
+#include <algorithm>
+
+namespace {
+
+// weight of the latest measurement in the moving averages
+const double COST_SMOOTHING = 0.2;
+
+double Smooth(double average, double value) {
+    if (average <= 0) {
+        return value;
+    }
+
+    return average + COST_SMOOTHING * (value - average);
+}
+
+} // namespace
+
+namespace detection {
+
+KeyframeScheduler::Parameters::Parameters(uint32_t base_interval,
+                                          uint32_t max_interval,
+                                          uint32_t min_interval,
+                                          double min_tracking_confidence,
+                                          double frame_budget_ms):
+    base_interval(base_interval),
+    max_interval(max_interval),
+    min_interval(min_interval),
+    min_tracking_confidence(min_tracking_confidence),
+    frame_budget_ms(frame_budget_ms) {
+    // empty on purpose
+}
+
+KeyframeScheduler::Parameters::Parameters(const Parameters& that):
+    base_interval(that.base_interval),
+    max_interval(that.max_interval),
+    min_interval(that.min_interval),
+    min_tracking_confidence(that.min_tracking_confidence),
+    frame_budget_ms(that.frame_budget_ms) {
+    // empty on purpose
+}
+
+KeyframeScheduler::Parameters& KeyframeScheduler::Parameters::operator=(const Parameters& that) {
+    if (this != &that) {
+        this->base_interval = that.base_interval;
+        this->max_interval = that.max_interval;
+        this->min_interval = that.min_interval;
+        this->min_tracking_confidence = that.min_tracking_confidence;
+        this->frame_budget_ms = that.frame_budget_ms;
+    }
+
+    return *this;
+}
+
+KeyframeScheduler::KeyframeScheduler(const Parameters& parameters):
+    _parameters(parameters),
+    _interval(std::max(1u, parameters.base_interval)),
+    _frames_since_keyframe(0),
+    _has_keyframe(false),
+    _tracked_faces(0),
+    _has_tracking_alarm(false),
+    _detection_cost(0),
+    _tracking_cost(0),
+    _budget_credit(0),
+    _stats({ 0, 0, 0, 0 }) {
+    // the interval cannot grow beyond the maximum
+    _parameters.max_interval = std::max(_parameters.max_interval, _interval);
+}
+
+KeyframeScheduler::KeyframeScheduler(const KeyframeScheduler& that):
+    _parameters(that._parameters),
+    _interval(that._interval),
+    _frames_since_keyframe(that._frames_since_keyframe),
+    _has_keyframe(that._has_keyframe),
+    _tracked_faces(that._tracked_faces),
+    _has_tracking_alarm(that._has_tracking_alarm),
+    _detection_cost(that._detection_cost),
+    _tracking_cost(that._tracking_cost),
+    _budget_credit(that._budget_credit),
+    _stats(that._stats) {
+    // empty on purpose
+}
+
+KeyframeScheduler& KeyframeScheduler::operator=(const KeyframeScheduler& that) {
+    if (this != &that) {
+        this->_parameters = that._parameters;
+        this->_interval = that._interval;
+        this->_frames_since_keyframe = that._frames_since_keyframe;
+        this->_has_keyframe = that._has_keyframe;
+        this->_tracked_faces = that._tracked_faces;
+        this->_has_tracking_alarm = that._has_tracking_alarm;
+        this->_detection_cost = that._detection_cost;
+        this->_tracking_cost = that._tracking_cost;
+        this->_budget_credit = that._budget_credit;
+        this->_stats = that._stats;
+    }
+
+    return *this;
+}
+
+bool KeyframeScheduler::isKeyframe(bool is_scene_cut) {
+    _stats.frames += 1;
+
+    if (!_has_keyframe) {
+        return true;
+    }
+
+    if (is_scene_cut) {
+        // faces of the previous scene are gone,
+        // there is nothing to track anymore
+        _stats.scene_cuts += 1;
+        _has_tracking_alarm = true;
+        return true;
+    }
+
+    // distance from the latest keyframe to the frame in question
+    uint32_t distance = _frames_since_keyframe + 1;
+
+    if (distance >= _parameters.max_interval) {
+        return true;
+    }
+
+    bool is_alarm = _has_tracking_alarm && distance >= _parameters.min_interval;
+    bool is_due = distance >= _interval;
+
+    if (!is_alarm && !is_due) {
+        return false;
+    }
+
+    // the detection can wait while it does not fit into the budget,
+    // frames that are cheaper than the budget save time for it
+    if (_parameters.frame_budget_ms > 0
+        && _budget_credit < _detection_cost - _parameters.frame_budget_ms) {
+        return false;
+    }
+
+    if (is_alarm) {
+        _stats.tracking_alarms += 1;
+    }
+
+    return true;
+}
+
+void KeyframeScheduler::onDetected(size_t faces_count, double elapsed_ms, bool is_full_scan) {
+    // the detector has only confirmed what the trackers have been
+    // following, so the scene is quiet and can be checked less often
+    bool is_confirmation = _has_keyframe && !_has_tracking_alarm && faces_count == _tracked_faces;
+
+    if (!is_confirmation) {
+        _interval = std::max(1u, _parameters.base_interval);
+    } else if (is_full_scan) {
+        _interval = std::min(_interval * 2, _parameters.max_interval);
+    }
+
+    _has_keyframe = true;
+    _frames_since_keyframe = 0;
+    _tracked_faces = faces_count;
+    _has_tracking_alarm = false;
+
+    _detection_cost = Smooth(_detection_cost, elapsed_ms);
+    spend(elapsed_ms);
+
+    _stats.keyframes += 1;
+}
+
+void KeyframeScheduler::onTracked(const std::vector<double>& confidences, double elapsed_ms) {
+    _frames_since_keyframe += 1;
+
+    for (const auto& confidence: confidences) {
+        if (confidence < _parameters.min_tracking_confidence) {
+            _has_tracking_alarm = true;
+        }
+    }
+
+    _tracking_cost = Smooth(_tracking_cost, elapsed_ms);
+    spend(elapsed_ms);
+}
+
+void KeyframeScheduler::spend(double elapsed_ms) {
+    if (_parameters.frame_budget_ms <= 0) {
+        return;
+    }
+
+    _budget_credit += _parameters.frame_budget_ms - elapsed_ms;
+
+    // saving more than one detection needs makes no sense,
+    // and a long debt would block detections for too long
+    _budget_credit = std::min(_budget_credit, std::max(_detection_cost, _parameters.frame_budget_ms));
+    _budget_credit = std::max(_budget_credit, -_detection_cost);
+}
+
+KeyframeScheduler::Stats KeyframeScheduler::stats() const {
+    return _stats;
+}
+
+} // namespace detection
@@ -90,11 +90,14 @@ std::string LabelsResolver::obtainLabelById(int32_t id) {
         return UNKNOWN_LABEL;
     }
 
-    if (_id_to_label_lookup_table.find(id) == _id_to_label_lookup_table.end()) {
+    // lookup never modifies the table, so the resolver
+    // can be shared between threads after it has been read
+    const auto& iterator = _id_to_label_lookup_table.find(id);
+    if (iterator == _id_to_label_lookup_table.end()) {
         throw std::runtime_error("Cannot find the given id.");
     }
 
-    return _id_to_label_lookup_table[id];
+    return iterator->second;
 }
 
 int32_t LabelsResolver::operator[](const std::string& label) {
@@ -0,0 +1,47 @@
+#include "mat_arena.h"
+
+#include <algorithm>
+
+namespace detection {
+
+MatArena::MatArena(std::atomic<uint64_t>& allocations):
+    _buffers(),
+    _allocations(allocations) {
+    // empty on purpose
+}
+
+bool MatArena::IsShared(const cv::Mat& buffer) {
+    // the buffer holds one reference itself, views
+    // are released by other threads, so the counter
+    // is read the way OpenCV changes it, atomically
+    return buffer.u != nullptr && CV_XADD(&buffer.u->refcount, 0) > 1;
+}
+
+cv::Mat MatArena::acquire(int rows, int cols, int type) {
+    cv::Rect view(0, 0, cols, rows);
+
+    for (auto& buffer: _buffers) {
+        if (!IsShared(buffer) && buffer.type() == type && buffer.rows >= rows && buffer.cols >= cols) {
+            return buffer(view);
+        }
+    }
+
+    // growing a free buffer keeps the number of buffers low
+    for (auto& buffer: _buffers) {
+        if (!IsShared(buffer)) {
+            buffer.create(std::max(rows, buffer.rows), std::max(cols, buffer.cols), type);
+            _allocations.fetch_add(1, std::memory_order_relaxed);
+            return buffer(view);
+        }
+    }
+
+    _buffers.emplace_back(rows, cols, type);
+    _allocations.fetch_add(1, std::memory_order_relaxed);
+    return _buffers.back()(view);
+}
+
+size_t MatArena::size() const {
+    return _buffers.size();
+}
+
+} // namespace detection
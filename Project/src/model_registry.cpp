@@ -0,0 +1,10 @@
+#include "model_registry.h"
+
+namespace detection {
+
+ModelRegistry& ModelRegistry::shared() {
+    static ModelRegistry registry;
+    return registry;
+}
+
+} // namespace detection
@@ -0,0 +1,296 @@
+#include "mosse_tracker.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+
+// keeps the filter finite where the spectrum has no energy
+const double FILTER_REGULARISATION = 1e-5;
+// in template pixels, the area around the peak
+// that does not count as the sidelobe
+const int PEAK_EXCLUSION_RADIUS = 5;
+// perturbations of the training samples
+const double MAX_TRAINING_ANGLE = 0.1;
+const double MAX_TRAINING_SCALE_CHANGE = 0.05;
+
+} // namespace
+
+namespace detection {
+
+MosseTracker::Parameters::Parameters(int template_size,
+                                     double padding,
+                                     double learning_rate,
+                                     double sigma,
+                                     int training_samples,
+                                     double lost_psr,
+                                     double confident_psr):
+    template_size(template_size),
+    padding(padding),
+    learning_rate(learning_rate),
+    sigma(sigma),
+    training_samples(training_samples),
+    lost_psr(lost_psr),
+    confident_psr(confident_psr) {
+    // empty on purpose
+}
+
+MosseTracker::Parameters::Parameters(const Parameters& that):
+    template_size(that.template_size),
+    padding(that.padding),
+    learning_rate(that.learning_rate),
+    sigma(that.sigma),
+    training_samples(that.training_samples),
+    lost_psr(that.lost_psr),
+    confident_psr(that.confident_psr) {
+    // empty on purpose
+}
+
+MosseTracker::Parameters& MosseTracker::Parameters::operator=(const Parameters& that) {
+    if (this != &that) {
+        this->template_size = that.template_size;
+        this->padding = that.padding;
+        this->learning_rate = that.learning_rate;
+        this->sigma = that.sigma;
+        this->training_samples = that.training_samples;
+        this->lost_psr = that.lost_psr;
+        this->confident_psr = that.confident_psr;
+    }
+
+    return *this;
+}
+
+cv::Ptr<MosseTracker> MosseTracker::create(const Parameters& parameters) {
+    return cv::makePtr<MosseTracker>(parameters);
+}
+
+MosseTracker::MosseTracker(const Parameters& parameters):
+    _parameters(parameters),
+    _box(),
+    _psr(0),
+    _target(),
+    _numerator(),
+    _denominator(),
+    _filter(),
+    _grey(),
+    _warp(),
+    _raw_patch(),
+    _patch(),
+    _window(),
+    _spectrum(),
+    _product(),
+    _energy(),
+    _response() {
+    if (parameters.template_size <= 2 * PEAK_EXCLUSION_RADIUS + 1) {
+        throw std::runtime_error("Template is too small for the tracker.");
+    }
+
+    if (parameters.training_samples < 1) {
+        throw std::runtime_error("Tracker needs at least one training sample.");
+    }
+}
+
+void MosseTracker::allocate() {
+    const int size = _parameters.template_size;
+
+    if (_patch.rows == size) {
+        return;
+    }
+
+    const cv::Size template_size(size, size);
+
+    cv::createHanningWindow(_window, template_size, CV_32F);
+
+    // the desired response is a sharp peak in the middle of the patch
+    cv::Mat target(template_size, CV_32F);
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            double dx = x - size / 2;
+            double dy = y - size / 2;
+            target.at<float>(y, x) = static_cast<float>(
+                    std::exp(-(dx * dx + dy * dy) / (2 * _parameters.sigma * _parameters.sigma)));
+        }
+    }
+    cv::dft(target, _target, cv::DFT_COMPLEX_OUTPUT);
+
+    _numerator.create(template_size, CV_32FC2);
+    _denominator.create(template_size, CV_32FC2);
+    _filter.create(template_size, CV_32FC2);
+    _spectrum.create(template_size, CV_32FC2);
+    _product.create(template_size, CV_32FC2);
+    _energy.create(template_size, CV_32FC2);
+
+    _warp.create(2, 3, CV_64F);
+    _raw_patch.create(template_size, CV_8U);
+    _patch.create(template_size, CV_32F);
+    _response.create(template_size, CV_32F);
+}
+
+cv::Mat MosseTracker::toGrey(cv::InputArray image) {
+    cv::Mat frame = image.getMat();
+
+    if (frame.channels() == 1) {
+        return frame;
+    }
+
+    cv::cvtColor(frame, _grey, cv::COLOR_BGR2GRAY);
+    return _grey;
+}
+
+void MosseTracker::extractPatch(const cv::Mat& grey, const cv::Rect2d& box, double angle, double scale) {
+    const double size = _parameters.template_size;
+
+    // maps the patch back to the frame: the patch is centered
+    // on the box and covers it together with the padding
+    double scale_x = box.width * _parameters.padding * scale / size;
+    double scale_y = box.height * _parameters.padding * scale / size;
+    double cos_angle = std::cos(angle);
+    double sin_angle = std::sin(angle);
+
+    double center_x = box.x + box.width / 2.0;
+    double center_y = box.y + box.height / 2.0;
+
+    double* warp = _warp.ptr<double>();
+    warp[0] = cos_angle * scale_x;
+    warp[1] = -sin_angle * scale_y;
+    warp[3] = sin_angle * scale_x;
+    warp[4] = cos_angle * scale_y;
+    warp[2] = center_x - (warp[0] + warp[1]) * size / 2.0;
+    warp[5] = center_y - (warp[3] + warp[4]) * size / 2.0;
+
+    cv::warpAffine(grey, _raw_patch, _warp, _raw_patch.size(),
+                   cv::INTER_LINEAR | cv::WARP_INVERSE_MAP, cv::BORDER_REPLICATE);
+
+    // log transform and normalisation reduce the effect of lighting,
+    // the window suppresses the edges of the patch
+    _raw_patch.convertTo(_patch, CV_32F, 1.0, 1.0);
+    cv::log(_patch, _patch);
+
+    cv::Scalar mean;
+    cv::Scalar deviation;
+    cv::meanStdDev(_patch, mean, deviation);
+
+    double inverse_deviation = 1.0 / (deviation[0] + 1e-5);
+    _patch.convertTo(_patch, CV_32F, inverse_deviation, -mean[0] * inverse_deviation);
+    cv::multiply(_patch, _window, _patch);
+
+    cv::dft(_patch, _spectrum, cv::DFT_COMPLEX_OUTPUT);
+}
+
+void MosseTracker::learn(double new_weight, double old_weight) {
+    cv::mulSpectrums(_target, _spectrum, _product, 0, true);
+    cv::addWeighted(_product, new_weight, _numerator, old_weight, 0, _numerator);
+
+    cv::mulSpectrums(_spectrum, _spectrum, _product, 0, true);
+    cv::addWeighted(_product, new_weight, _denominator, old_weight, 0, _denominator);
+}
+
+void MosseTracker::computeFilter() {
+    // the denominator is real, its real part goes
+    // to both channels to divide the complex numerator
+    const int from_to[] = { 0, 0, 0, 1 };
+    cv::mixChannels(&_denominator, 1, &_energy, 1, from_to, 2);
+    cv::add(_energy, cv::Scalar::all(FILTER_REGULARISATION), _energy);
+
+    cv::divide(_numerator, _energy, _filter);
+}
+
+void MosseTracker::init(cv::InputArray image, const cv::Rect& bounding_box) {
+    if (bounding_box.empty()) {
+        throw std::runtime_error("Cannot track an empty box.");
+    }
+
+    allocate();
+
+    cv::Mat grey = toGrey(image);
+    _box = cv::Rect2d(bounding_box);
+
+    _numerator.setTo(cv::Scalar::all(0));
+    _denominator.setTo(cv::Scalar::all(0));
+
+    // a fixed seed keeps tracking reproducible
+    cv::RNG random(42);
+
+    for (int i = 0; i < _parameters.training_samples; i++) {
+        double angle = 0;
+        double scale = 1;
+
+        // the first sample is the face as it is, the others
+        // teach the filter to survive small rotations and zoom
+        if (i > 0) {
+            angle = random.uniform(-MAX_TRAINING_ANGLE, MAX_TRAINING_ANGLE);
+            scale = 1 + random.uniform(-MAX_TRAINING_SCALE_CHANGE, MAX_TRAINING_SCALE_CHANGE);
+        }
+
+        extractPatch(grey, _box, angle, scale);
+        learn(1, 1);
+    }
+
+    computeFilter();
+    _psr = _parameters.confident_psr;
+}
+
+bool MosseTracker::update(cv::InputArray image, cv::Rect& bounding_box) {
+    if (_patch.empty()) {
+        throw std::runtime_error("Tracker has not been initialised.");
+    }
+
+    cv::Mat grey = toGrey(image);
+
+    extractPatch(grey, _box, 0, 1);
+    cv::mulSpectrums(_spectrum, _filter, _product, 0, false);
+    cv::idft(_product, _response, cv::DFT_SCALE | cv::DFT_REAL_OUTPUT);
+
+    double peak = 0;
+    cv::Point peak_location;
+    cv::minMaxLoc(_response, nullptr, &peak, nullptr, &peak_location);
+
+    // the sidelobe is everything but the area around the peak
+    cv::Rect peak_area(peak_location.x - PEAK_EXCLUSION_RADIUS,
+                       peak_location.y - PEAK_EXCLUSION_RADIUS,
+                       2 * PEAK_EXCLUSION_RADIUS + 1,
+                       2 * PEAK_EXCLUSION_RADIUS + 1);
+    peak_area &= cv::Rect(0, 0, _response.cols, _response.rows);
+
+    cv::Mat peak_response = _response(peak_area);
+    double sidelobe_count = static_cast<double>(_response.total() - peak_response.total());
+    double sidelobe_sum = cv::sum(_response)[0] - cv::sum(peak_response)[0];
+    double sidelobe_squares = cv::norm(_response, cv::NORM_L2SQR) - cv::norm(peak_response, cv::NORM_L2SQR);
+
+    double sidelobe_mean = sidelobe_sum / sidelobe_count;
+    double sidelobe_variance = std::max(0.0, sidelobe_squares / sidelobe_count - sidelobe_mean * sidelobe_mean);
+    _psr = (peak - sidelobe_mean) / (std::sqrt(sidelobe_variance) + 1e-5);
+
+    if (_psr < _parameters.lost_psr) {
+        // the filter is not updated, so the face
+        // can be found again if it comes back
+        return false;
+    }
+
+    const double size = _parameters.template_size;
+    _box.x += (peak_location.x - size / 2) * _box.width * _parameters.padding / size;
+    _box.y += (peak_location.y - size / 2) * _box.height * _parameters.padding / size;
+
+    extractPatch(grey, _box, 0, 1);
+    learn(_parameters.learning_rate, 1 - _parameters.learning_rate);
+    computeFilter();
+
+    bounding_box = cv::Rect(cvRound(_box.x), cvRound(_box.y), cvRound(_box.width), cvRound(_box.height));
+    return true;
+}
+
+double MosseTracker::psr() const {
+    return _psr;
+}
+
+double MosseTracker::confidence() const {
+    if (_psr < _parameters.lost_psr) {
+        return 0;
+    }
+
+    double confidence = (_psr - _parameters.lost_psr) / (_parameters.confident_psr - _parameters.lost_psr);
+    return std::min(1.0, std::max(0.0, confidence));
+}
+
+} // namespace detection
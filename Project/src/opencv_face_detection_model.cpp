@@ -1,123 +1,441 @@
 #include "opencv_face_detection_model.h"
 
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "thread_pool.h"
+
+namespace {
+
+std::shared_ptr<detection::ObjectPool<cv::CascadeClassifier>> CreateCascadesPool(const std::string& file_path) {
+    // copies of a cascade share its buffers,
+    // so every pooled cascade is loaded on its own
+    return std::make_shared<detection::ObjectPool<cv::CascadeClassifier>>(
+        0 /* capacity */,
+        [file_path]() {
+            return std::make_unique<cv::CascadeClassifier>(file_path);
+        });
+}
+
+template <typename T>
+void ReadIfPresent(const cv::FileStorage& file_storage, const std::string& name, T& out_value) {
+    cv::FileNode node = file_storage[name];
+    if (node.empty()) {
+        return;
+    }
+
+    // file storage only knows ints and doubles
+    if (node.isInt()) {
+        out_value = static_cast<T>(static_cast<int>(node));
+    } else {
+        out_value = static_cast<T>(static_cast<double>(node));
+    }
+}
+
+} // namespace
+
 namespace detection {
 
-OpenCVFaceDetectionModel::OpenCVFaceDetectionModel(double face_scale_factor,
-                                                   uint32_t face_min_neighbours,
-                                                   double eyes_scale_factor,
-                                                   uint32_t eyes_min_neighbours,
+OpenCVFaceDetectionModel::FaceScratch::FaceScratch(std::atomic<uint64_t>& allocations):
+    eyes(),
+    aligned_faces(allocations) {
+    // empty on purpose
+}
+
+OpenCVFaceDetectionModel::Parameters::Parameters(double face_scale_factor,
+                                                 uint32_t face_min_neighbours,
+                                                 uint32_t min_face_size,
+                                                 uint32_t max_face_size,
+                                                 double eyes_scale_factor,
+                                                 uint32_t eyes_min_neighbours,
+                                                 double min_eye_size,
+                                                 double max_eye_size,
+                                                 bool restrict_eyes_search):
+    face_scale_factor(face_scale_factor),
+    face_min_neighbours(face_min_neighbours),
+    min_face_size(min_face_size),
+    max_face_size(max_face_size),
+    eyes_scale_factor(eyes_scale_factor),
+    eyes_min_neighbours(eyes_min_neighbours),
+    min_eye_size(min_eye_size),
+    max_eye_size(max_eye_size),
+    restrict_eyes_search(restrict_eyes_search) {
+    // empty on purpose
+}
+
+OpenCVFaceDetectionModel::Parameters::Parameters(const Parameters& that):
+    face_scale_factor(that.face_scale_factor),
+    face_min_neighbours(that.face_min_neighbours),
+    min_face_size(that.min_face_size),
+    max_face_size(that.max_face_size),
+    eyes_scale_factor(that.eyes_scale_factor),
+    eyes_min_neighbours(that.eyes_min_neighbours),
+    min_eye_size(that.min_eye_size),
+    max_eye_size(that.max_eye_size),
+    restrict_eyes_search(that.restrict_eyes_search) {
+    // empty on purpose
+}
+
+OpenCVFaceDetectionModel::Parameters& OpenCVFaceDetectionModel::Parameters::operator=(const Parameters& that) {
+    if (this != &that) {
+        this->face_scale_factor = that.face_scale_factor;
+        this->face_min_neighbours = that.face_min_neighbours;
+        this->min_face_size = that.min_face_size;
+        this->max_face_size = that.max_face_size;
+        this->eyes_scale_factor = that.eyes_scale_factor;
+        this->eyes_min_neighbours = that.eyes_min_neighbours;
+        this->min_eye_size = that.min_eye_size;
+        this->max_eye_size = that.max_eye_size;
+        this->restrict_eyes_search = that.restrict_eyes_search;
+    }
+
+    return *this;
+}
+
+void OpenCVFaceDetectionModel::Parameters::read(const std::string& file) {
+    cv::FileStorage file_storage(file, cv::FileStorage::READ);
+
+    if (!file_storage.isOpened()) {
+        throw std::runtime_error("Cannot open " + file);
+    }
+
+    ReadIfPresent(file_storage, "face_scale_factor", face_scale_factor);
+    ReadIfPresent(file_storage, "face_min_neighbours", face_min_neighbours);
+    ReadIfPresent(file_storage, "min_face_size", min_face_size);
+    ReadIfPresent(file_storage, "max_face_size", max_face_size);
+    ReadIfPresent(file_storage, "eyes_scale_factor", eyes_scale_factor);
+    ReadIfPresent(file_storage, "eyes_min_neighbours", eyes_min_neighbours);
+    ReadIfPresent(file_storage, "min_eye_size", min_eye_size);
+    ReadIfPresent(file_storage, "max_eye_size", max_eye_size);
+    ReadIfPresent(file_storage, "restrict_eyes_search", restrict_eyes_search);
+}
+
+void OpenCVFaceDetectionModel::Parameters::write(const std::string& file) const {
+    cv::FileStorage file_storage(file, cv::FileStorage::WRITE);
+
+    if (!file_storage.isOpened()) {
+        throw std::runtime_error("Cannot open " + file);
+    }
+
+    file_storage.write("face_scale_factor", face_scale_factor);
+    file_storage.write("face_min_neighbours", static_cast<int>(face_min_neighbours));
+    file_storage.write("min_face_size", static_cast<int>(min_face_size));
+    file_storage.write("max_face_size", static_cast<int>(max_face_size));
+    file_storage.write("eyes_scale_factor", eyes_scale_factor);
+    file_storage.write("eyes_min_neighbours", static_cast<int>(eyes_min_neighbours));
+    file_storage.write("min_eye_size", min_eye_size);
+    file_storage.write("max_eye_size", max_eye_size);
+    file_storage.write("restrict_eyes_search", static_cast<int>(restrict_eyes_search));
+}
+
+OpenCVFaceDetectionModel::OpenCVFaceDetectionModel(const Parameters& parameters,
                                                    const std::string& face_cascade_file_path,
                                                    const std::string& right_eye_cascade_file_path,
                                                    const std::string& left_eye_cascade_file_path):
-    _face_scale_factor(face_scale_factor),
-    _face_min_neighbours(face_min_neighbours),
-    _eyes_scale_factor(eyes_scale_factor),
-    _eyes_min_neighbours(eyes_min_neighbours),
+    _parameters(parameters),
     _face_cascade(),
-    _right_eye_cascade(),
-    _left_eye_cascade(left_eye_cascade_file_path) {
+    _right_eye_cascades(CreateCascadesPool(right_eye_cascade_file_path)),
+    _left_eye_cascades(CreateCascadesPool(left_eye_cascade_file_path)),
+    _frames(0),
+    _allocations(0),
+    _greyscale_frames(_allocations),
+    _downscaled_frame(),
+    _faces(),
+    _visible_faces(),
+    _aligned_faces(),
+    _left_eyes(),
+    _right_eyes(),
+    _face_scratches(createFaceScratches()) {
     _face_cascade.load(face_cascade_file_path);
-    _right_eye_cascade.load(right_eye_cascade_file_path);
-    _left_eye_cascade.load(left_eye_cascade_file_path);
 }
 
 OpenCVFaceDetectionModel::OpenCVFaceDetectionModel(const OpenCVFaceDetectionModel& that):
-    _face_scale_factor(that._face_scale_factor),
-    _face_min_neighbours(that._face_min_neighbours),
-    _eyes_scale_factor(that._eyes_scale_factor),
-    _eyes_min_neighbours(that._eyes_min_neighbours),
+    FaceDetectionModel(that),
+    _parameters(that._parameters),
     _face_cascade(that._face_cascade),
-    _right_eye_cascade(that._right_eye_cascade),
-    _left_eye_cascade(that._left_eye_cascade) {
+    _right_eye_cascades(that._right_eye_cascades),
+    _left_eye_cascades(that._left_eye_cascades),
+    _frames(0),
+    _allocations(0),
+    _greyscale_frames(_allocations),
+    _downscaled_frame(),
+    _faces(),
+    _visible_faces(),
+    _aligned_faces(),
+    _left_eyes(),
+    _right_eyes(),
+    _face_scratches(createFaceScratches()) {
     // empty on purpose
 }
 
 OpenCVFaceDetectionModel& OpenCVFaceDetectionModel::operator=(const OpenCVFaceDetectionModel& that) {
     if (this != &that) {
-        this->_face_scale_factor = that._face_scale_factor;
-        this->_face_min_neighbours = that._face_min_neighbours;
-        this->_eyes_scale_factor = that._eyes_scale_factor;
-        this->_eyes_min_neighbours = that._eyes_min_neighbours;
+        FaceDetectionModel::operator=(that);
+        this->_parameters = that._parameters;
         this->_face_cascade = that._face_cascade;
-        this->_right_eye_cascade = that._right_eye_cascade;
-        this->_left_eye_cascade = that._left_eye_cascade;
+        this->_right_eye_cascades = that._right_eye_cascades;
+        this->_left_eye_cascades = that._left_eye_cascades;
     }
 
     return *this;
 }
 
+std::unique_ptr<ObjectPool<OpenCVFaceDetectionModel::FaceScratch>> OpenCVFaceDetectionModel::createFaceScratches() {
+    return std::make_unique<ObjectPool<FaceScratch>>(
+        0 /* capacity */,
+        [this]() {
+            _allocations.fetch_add(1, std::memory_order_relaxed);
+            return std::make_unique<FaceScratch>(_allocations);
+        });
+}
+
+void OpenCVFaceDetectionModel::countGrowth(size_t old_capacity, size_t new_capacity) {
+    if (new_capacity != old_capacity) {
+        _allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
 std::vector<Face> OpenCVFaceDetectionModel::extractFaces(const Rect& viewport, cv::Mat& image) {
     std::vector<Face> result_faces;
 
-    cv::Mat greyscale_image;
+    _frames.fetch_add(1, std::memory_order_relaxed);
+
+    cv::Mat greyscale_image = _greyscale_frames.acquire(image.rows, image.cols, CV_8UC1);
     cv::cvtColor(image, greyscale_image, cv::COLOR_BGR2GRAY);
 
-    std::vector<cv::Rect> faces;
-    _face_cascade.detectMultiScale(greyscale_image, faces, _face_scale_factor, _face_min_neighbours);
+    // the cascade runs on the downscaled frame,
+    // eyes are searched at full resolution
+    const uchar* downscaled_data = _downscaled_frame.data;
+    cv::Mat search_image = downscale(greyscale_image, _downscaled_frame);
+    if (_downscaled_frame.data != downscaled_data) {
+        _allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    size_t capacity = _faces.capacity();
+    _face_cascade.detectMultiScale(search_image, _faces, _parameters.face_scale_factor, _parameters.face_min_neighbours,
+                                   0 /* flags */, minFaceSize(_detection_scale), maxFaceSize(_detection_scale));
+    countGrowth(capacity, _faces.capacity());
 
-    for(size_t i = 0; i < faces.size(); i++) {
-        cv::Rect face = faces[i];
-        cv::Mat face_area = greyscale_image(face);
-        const auto& face_origin = Rect::from(face);
+    cv::Rect frame(0, 0, image.cols, image.rows);
+    for (auto& face: _faces) {
+        face = toFullResolution(face) & frame;
+    }
 
-        if (shouldClip(viewport, face_origin)) {
+    collectFaces(viewport, greyscale_image, Rect(0, 0, image.cols, image.rows), _faces, result_faces);
+
+    return result_faces;
+}
+
+std::vector<Face> OpenCVFaceDetectionModel::extractFaces(const Rect& viewport,
+                                                         cv::Mat& image,
+                                                         const std::vector<Rect>& rois) {
+    std::vector<Face> result_faces;
+
+    _frames.fetch_add(1, std::memory_order_relaxed);
+
+    Rect frame(0, 0, image.cols, image.rows);
+    Rect visible_viewport = viewport.intersection(frame);
+
+    std::vector<Face> region_faces;
+
+    for (const auto& roi: rois) {
+        if (roi.empty()) {
             continue;
         }
 
-        std::vector<cv::Rect> left_eyes;
-        std::vector<cv::Rect> right_eyes;
+        for (const auto& region: searchRegions(visible_viewport, { roi })) {
+            cv::Mat greyscale_area = _greyscale_frames.acquire(region.height, region.width, CV_8UC1);
+            cv::cvtColor(image(Rect::toCVRect(region)), greyscale_area, cv::COLOR_BGR2GRAY);
+
+            double roi_size = std::sqrt(static_cast<double>(roi.area()));
+            cv::Size min_size(static_cast<int>(roi_size / DEFAULT_ROI_SIZE_TOLERANCE),
+                              static_cast<int>(roi_size / DEFAULT_ROI_SIZE_TOLERANCE));
+            cv::Size max_size(static_cast<int>(roi_size * DEFAULT_ROI_SIZE_TOLERANCE),
+                              static_cast<int>(roi_size * DEFAULT_ROI_SIZE_TOLERANCE));
+
+            // regions are searched at full resolution
+            min_size = cv::Size(std::max(min_size.width, minFaceSize(1.0).width),
+                                std::max(min_size.height, minFaceSize(1.0).height));
+            if (!maxFaceSize(1.0).empty()) {
+                max_size = cv::Size(std::min(max_size.width, maxFaceSize(1.0).width),
+                                    std::min(max_size.height, maxFaceSize(1.0).height));
+            }
+
+            if (min_size.width > max_size.width || min_size.height > max_size.height) {
+                continue;
+            }
+
+            size_t capacity = _faces.capacity();
+            _face_cascade.detectMultiScale(greyscale_area, _faces, _parameters.face_scale_factor, _parameters.face_min_neighbours,
+                                           0 /* flags */, min_size, max_size);
+            countGrowth(capacity, _faces.capacity());
+
+            region_faces.clear();
+            collectFaces(visible_viewport, greyscale_area, region, _faces, region_faces);
+
+            for (const auto& face: region_faces) {
+                AppendUnique(result_faces, face);
+            }
+        }
+    }
+
+    return result_faces;
+}
+
+cv::Size OpenCVFaceDetectionModel::minFaceSize(double scale) const {
+    int size = static_cast<int>(std::floor(_parameters.min_face_size * scale));
+    return cv::Size(size, size);
+}
+
+cv::Size OpenCVFaceDetectionModel::maxFaceSize(double scale) const {
+    // empty size lets the cascade grow its window up to the image size
+    int size = static_cast<int>(std::ceil(_parameters.max_face_size * scale));
+    return cv::Size(size, size);
+}
+
+OpenCVFaceDetectionModel::Stats OpenCVFaceDetectionModel::stats() const {
+    return {
+        _frames.load(std::memory_order_relaxed),
+        _allocations.load(std::memory_order_relaxed)
+    };
+}
+
+cv::Rect OpenCVFaceDetectionModel::findEye(ObjectPool<cv::CascadeClassifier>& cascades,
+                                           const cv::Mat& face_area,
+                                           const cv::Rect& search_area) {
+    // the scratch is always leased before the cascade,
+    // so threads never wait for each other in a cycle
+    auto scratch = _face_scratches->acquire();
+    std::vector<cv::Rect>& eyes = scratch->eyes;
+
+    size_t capacity = eyes.capacity();
 
-        _left_eye_cascade.detectMultiScale(face_area, left_eyes, _eyes_scale_factor, _eyes_min_neighbours);
-        _right_eye_cascade.detectMultiScale(face_area, right_eyes, _eyes_scale_factor, _eyes_min_neighbours);
+    // eye bounds are relative to the face, zero leaves them open
+    int min_eye_size = static_cast<int>(std::floor(face_area.cols * _parameters.min_eye_size));
+    int max_eye_size = static_cast<int>(std::ceil(face_area.cols * _parameters.max_eye_size));
 
-        cv::Rect left_eye;
-        cv::Rect right_eye;
-        cv::Mat output_image = face_area;
+    {
+        auto cascade = cascades.acquire();
+        cascade->detectMultiScale(face_area(search_area), eyes, _parameters.eyes_scale_factor, _parameters.eyes_min_neighbours,
+                                  0 /* flags */, cv::Size(min_eye_size, min_eye_size), cv::Size(max_eye_size, max_eye_size));
+    }
+
+    countGrowth(capacity, eyes.capacity());
 
-        if (left_eyes.size() == 1 && right_eyes.size() == 1) {
-            float fx = static_cast<float>(face.x),
-                    fy = static_cast<float>(face.y),
-                    fw = static_cast<float>(face.width),
-                    fh = static_cast<float>(face.height);
+    if (eyes.size() != 1) {
+        return cv::Rect();
+    }
 
-            left_eye = left_eyes[0];
-            right_eye = right_eyes[0];
+    return eyes[0] + search_area.tl();
+}
 
-            float rx = static_cast<float>(right_eye.x),
-                    ry = static_cast<float>(right_eye.y),
-                    rw = static_cast<float>(right_eye.width),
-                    rh = static_cast<float>(right_eye.height);
+void OpenCVFaceDetectionModel::collectFaces(const Rect& viewport,
+                                            const cv::Mat& greyscale_area,
+                                            const Rect& area_origin,
+                                            const std::vector<cv::Rect>& faces,
+                                            std::vector<Face>& out_faces) {
+    size_t capacity = _visible_faces.capacity();
 
-            float lx = static_cast<float>(left_eye.x),
-                    ly = static_cast<float>(left_eye.y),
-                    lw = static_cast<float>(left_eye.width),
-                    lh = static_cast<float>(left_eye.height);
+    _visible_faces.clear();
+    for (const auto& face: faces) {
+        if (!shouldClip(viewport, Rect::from(face).escapeFromOldBasis(area_origin))) {
+            _visible_faces.push_back(face);
+        }
+    }
 
-            float dx = (lx + fw / 2 + lw / 2) - (rx + rw / 2),
-                    dy = (ly + lh / 2) - (ry + rh / 2);
+    countGrowth(capacity, _visible_faces.capacity());
 
-            // tricky way to calculate pi
-            float pi = atan(1) * 4;
+    for (auto* slots: { &_left_eyes, &_right_eyes }) {
+        capacity = slots->capacity();
+        slots->resize(_visible_faces.size());
+        countGrowth(capacity, slots->capacity());
+    }
 
-            float angle_rad = atan2(dy, dx);
-            float angle_degree = angle_rad * 180 / pi;
+    capacity = _aligned_faces.capacity();
+    _aligned_faces.resize(_visible_faces.size());
+    countGrowth(capacity, _aligned_faces.capacity());
 
-            float face_center_x = fx + fw / 2,
-                    face_center_y = fy + fh / 2;
+    // every face writes only its own slots
+    ThreadPool::shared().parallelFor(_visible_faces.size(), [&](size_t i) {
+        const cv::Rect& face = _visible_faces[i];
+        cv::Mat face_area = greyscale_area(face);
 
-            cv::Mat rotation_mat = cv::getRotationMatrix2D(cv::Point2f(face_center_x, face_center_y), angle_degree,
-                                                           1.0 /* scale */);
+        // the person's left eye is on the right side of the image
+        cv::Rect left_search_area(0, 0, face.width, face.height);
+        cv::Rect right_search_area(0, 0, face.width, face.height);
 
-            cv::warpAffine(face_area, output_image, rotation_mat, cv::Size2i(face_area.cols, face_area.rows));
+        if (_parameters.restrict_eyes_search) {
+            left_search_area = cv::Rect(face.width / 2, 0, face.width - face.width / 2, face.height / 2);
+            right_search_area = cv::Rect(0, 0, face.width / 2, face.height / 2);
         }
 
-        result_faces.push_back(Face(
-                output_image,
-                face_origin,
-                Eyes::from(left_eye, right_eye)));
+        // no lease may be held here: while waiting for the eyes,
+        // this thread runs tasks of other faces, which lease again
+        ThreadPool::shared().parallelFor(2, [&](size_t eye) {
+            if (eye == 0) {
+                _left_eyes[i] = findEye(*_left_eye_cascades, face_area, left_search_area);
+            } else {
+                _right_eyes[i] = findEye(*_right_eye_cascades, face_area, right_search_area);
+            }
+        });
+
+        // faces are only aligned by a pair of eyes
+        if (_left_eyes[i].empty() || _right_eyes[i].empty()) {
+            _left_eyes[i] = cv::Rect();
+            _right_eyes[i] = cv::Rect();
+            _aligned_faces[i] = face_area;
+            return;
+        }
+
+        const cv::Rect& left_eye = _left_eyes[i];
+        const cv::Rect& right_eye = _right_eyes[i];
+
+        double fw = static_cast<double>(face.width),
+                fh = static_cast<double>(face.height);
+
+        double rx = static_cast<double>(right_eye.x),
+                ry = static_cast<double>(right_eye.y),
+                rw = static_cast<double>(right_eye.width),
+                rh = static_cast<double>(right_eye.height);
+
+        double lx = static_cast<double>(left_eye.x),
+                ly = static_cast<double>(left_eye.y),
+                lw = static_cast<double>(left_eye.width),
+                lh = static_cast<double>(left_eye.height);
+
+        // both eyes are in the basis of the face
+        double dx = (lx + lw / 2) - (rx + rw / 2),
+                dy = (ly + lh / 2) - (ry + rh / 2);
+
+        double angle_rad = atan2(dy, dx);
+
+        // same as cv::getRotationMatrix2D around the centre of the face,
+        // the fixed size matrix lives on the stack
+        double alpha = cos(angle_rad),
+                beta = sin(angle_rad),
+                cx = fw / 2,
+                cy = fh / 2;
+
+        cv::Matx23d rotation_mat(alpha, beta, (1 - alpha) * cx - beta * cy,
+                                 -beta, alpha, beta * cx + (1 - alpha) * cy);
+
+        auto scratch = _face_scratches->acquire();
+        cv::Mat aligned_face = scratch->aligned_faces.acquire(face_area.rows, face_area.cols, face_area.type());
+        cv::warpAffine(face_area, aligned_face, rotation_mat, aligned_face.size());
+        _aligned_faces[i] = aligned_face;
+    });
+
+    for (size_t i = 0; i < _visible_faces.size(); i++) {
+        out_faces.push_back(Face(
+                _aligned_faces[i],
+                Rect::from(_visible_faces[i]).escapeFromOldBasis(area_origin),
+                Eyes::from(_left_eyes[i], _right_eyes[i])));
     }
 
-    return result_faces;
+    // otherwise the buffers would look
+    // referenced until the next frame
+    _aligned_faces.clear();
 }
 
 } // namespace detection
@@ -0,0 +1,105 @@
+#include "results_writer.h"
+
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+std::string EscapeJson(const std::string& value) {
+    std::ostringstream os;
+
+    for (const char c: value) {
+        switch (c) {
+            case '"': os << "\\\""; break;
+            case '\\': os << "\\\\"; break;
+            case '\n': os << "\\n"; break;
+            case '\r': os << "\\r"; break;
+            case '\t': os << "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    os << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+                       << static_cast<int>(c) << std::dec;
+                } else {
+                    os << c;
+                }
+        }
+    }
+
+    return os.str();
+}
+
+} // namespace
+
+namespace detection {
+
+ResultsWriter::ResultsWriter(const std::string& file):
+    _file_stream(),
+    _stream(&std::cout),
+    _stream_mutex() {
+    if (!file.empty()) {
+        _file_stream = std::make_unique<std::ofstream>(file);
+
+        if (!_file_stream->is_open()) {
+            throw std::runtime_error("Cannot open " + file + " for writing");
+        }
+
+        _stream = _file_stream.get();
+    }
+}
+
+void ResultsWriter::write(const std::string& video_file,
+                          uint32_t frame_id,
+                          bool is_keyframe,
+                          const std::vector<Rect>& faces_origins,
+                          const std::vector<std::string>& labels,
+                          const std::vector<double>& scores) {
+    if (faces_origins.size() != labels.size()) {
+        throw std::runtime_error("Faces and labels have different sizes.");
+    }
+
+    std::ostringstream os;
+    os << "{\"file\":\"" << EscapeJson(video_file) << "\""
+       << ",\"frame\":" << frame_id
+       << ",\"keyframe\":" << (is_keyframe ? "true" : "false")
+       << ",\"faces\":[";
+
+    bool is_first = true;
+    for (size_t i = 0; i < faces_origins.size(); i++) {
+        const auto& origin = faces_origins[i];
+
+        if (origin.empty()) {
+            // tracking of the face has been lost
+            continue;
+        }
+
+        if (!is_first) {
+            os << ",";
+        }
+        is_first = false;
+
+        os << "{\"x\":" << origin.x
+           << ",\"y\":" << origin.y
+           << ",\"width\":" << origin.width
+           << ",\"height\":" << origin.height
+           << ",\"label\":\"" << EscapeJson(labels[i]) << "\""
+           << ",\"score\":";
+
+        if (i < scores.size() && std::isfinite(scores[i])) {
+            os << scores[i];
+        } else {
+            os << "null";
+        }
+
+        os << "}";
+    }
+
+    os << "]}";
+
+    std::lock_guard<std::mutex> lock(_stream_mutex);
+    (*_stream) << os.str() << '\n';
+}
+
+} // namespace detection
@@ -0,0 +1,141 @@
+#include "scene_cut_detector.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace detection {
+
+SceneCutDetector::Parameters::Parameters(int thumbnail_width,
+                                         int thumbnail_height,
+                                         int histogram_bins,
+                                         int block_size,
+                                         double block_threshold,
+                                         double cut_threshold):
+    thumbnail_width(thumbnail_width),
+    thumbnail_height(thumbnail_height),
+    histogram_bins(histogram_bins),
+    block_size(block_size),
+    block_threshold(block_threshold),
+    cut_threshold(cut_threshold) {
+    // empty on purpose
+}
+
+SceneCutDetector::Parameters::Parameters(const Parameters& that):
+    thumbnail_width(that.thumbnail_width),
+    thumbnail_height(that.thumbnail_height),
+    histogram_bins(that.histogram_bins),
+    block_size(that.block_size),
+    block_threshold(that.block_threshold),
+    cut_threshold(that.cut_threshold) {
+    // empty on purpose
+}
+
+SceneCutDetector::Parameters& SceneCutDetector::Parameters::operator=(const Parameters& that) {
+    if (this != &that) {
+        this->thumbnail_width = that.thumbnail_width;
+        this->thumbnail_height = that.thumbnail_height;
+        this->histogram_bins = that.histogram_bins;
+        this->block_size = that.block_size;
+        this->block_threshold = that.block_threshold;
+        this->cut_threshold = that.cut_threshold;
+    }
+
+    return *this;
+}
+
+SceneCutDetector::SceneCutDetector(const Parameters& parameters):
+    _parameters(parameters),
+    _previous_thumbnail(),
+    _previous_histogram(),
+    _score(0),
+    _difference(),
+    _blocks() {
+    if (parameters.thumbnail_width <= 0 || parameters.thumbnail_height <= 0) {
+        throw std::runtime_error("Thumbnail size should be positive.");
+    }
+
+    if (parameters.block_size <= 0
+        || parameters.thumbnail_width % parameters.block_size != 0
+        || parameters.thumbnail_height % parameters.block_size != 0) {
+        throw std::runtime_error("Block size should divide the thumbnail size.");
+    }
+
+    if (parameters.histogram_bins <= 0) {
+        throw std::runtime_error("Number of histogram bins should be positive.");
+    }
+}
+
+SceneCutDetector::SceneCutDetector(const SceneCutDetector& that):
+    _parameters(that._parameters),
+    _previous_thumbnail(that._previous_thumbnail.clone()),
+    _previous_histogram(that._previous_histogram.clone()),
+    _score(that._score),
+    _difference(),
+    _blocks() {
+    // empty on purpose
+}
+
+SceneCutDetector& SceneCutDetector::operator=(const SceneCutDetector& that) {
+    if (this != &that) {
+        this->_parameters = that._parameters;
+        this->_previous_thumbnail = that._previous_thumbnail.clone();
+        this->_previous_histogram = that._previous_histogram.clone();
+        this->_score = that._score;
+    }
+
+    return *this;
+}
+
+bool SceneCutDetector::isCut(const cv::Mat& frame) {
+    // shrinking the colour frame first makes
+    // the conversion to grey almost free
+    cv::Mat small;
+    cv::resize(frame, small, cv::Size(_parameters.thumbnail_width, _parameters.thumbnail_height), 0, 0, cv::INTER_AREA);
+
+    cv::Mat thumbnail;
+    if (small.channels() == 3) {
+        cv::cvtColor(small, thumbnail, cv::COLOR_BGR2GRAY);
+    } else {
+        thumbnail = small;
+    }
+
+    int channels[] = { 0 };
+    int bins[] = { _parameters.histogram_bins };
+    float range[] = { 0, 256 };
+    const float* ranges[] = { range };
+
+    cv::Mat histogram;
+    cv::calcHist(&thumbnail, 1, channels, cv::Mat(), histogram, 1, bins, ranges);
+    histogram /= static_cast<double>(thumbnail.total());
+
+    if (_previous_thumbnail.empty()) {
+        _score = 1.0;
+    } else {
+        // half of L1 distance between normalised histograms is in [0, 1]
+        double histogram_distance = cv::norm(histogram, _previous_histogram, cv::NORM_L1) / 2.0;
+
+        // averaging the difference over blocks with area
+        // interpolation gives the mean absolute difference per block
+        cv::absdiff(thumbnail, _previous_thumbnail, _difference);
+        cv::resize(_difference, _blocks,
+                   cv::Size(_parameters.thumbnail_width / _parameters.block_size,
+                            _parameters.thumbnail_height / _parameters.block_size),
+                   0, 0, cv::INTER_AREA);
+
+        double changed_blocks = cv::countNonZero(_blocks > _parameters.block_threshold * 255.0);
+        double changed_part = changed_blocks / _blocks.total();
+
+        _score = std::min(histogram_distance, changed_part);
+    }
+
+    _previous_thumbnail = thumbnail;
+    _previous_histogram = histogram;
+
+    return _score >= _parameters.cut_threshold;
+}
+
+double SceneCutDetector::score() const {
+    return _score;
+}
+
+} // namespace detection
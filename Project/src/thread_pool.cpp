@@ -0,0 +1,217 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <exception>
+#include <limits>
+
+namespace {
+
+const size_t NOT_A_WORKER = std::numeric_limits<size_t>::max();
+
+// lets tasks know which deque belongs
+// to the worker that runs them
+thread_local const detection::ThreadPool* current_pool = nullptr;
+thread_local size_t current_queue = NOT_A_WORKER;
+
+} // namespace
+
+namespace detection {
+
+ThreadPool::ThreadPool(size_t threads):
+    _queues(),
+    _workers(),
+    _next_queue(0),
+    _pending_tasks(0),
+    _is_stopped(false),
+    _sleep_mutex(),
+    _task_submitted() {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (size_t i = 0; i < threads; i++) {
+        _queues.push_back(std::make_unique<WorkQueue>());
+    }
+
+    for (size_t i = 0; i < threads; i++) {
+        _workers.emplace_back(&ThreadPool::work, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(_sleep_mutex);
+        _is_stopped = true;
+    }
+
+    _task_submitted.notify_all();
+
+    for (auto& worker: _workers) {
+        worker.join();
+    }
+}
+
+ThreadPool& ThreadPool::shared() {
+    static ThreadPool pool;
+    return pool;
+}
+
+size_t ThreadPool::size() const {
+    return _workers.size();
+}
+
+size_t ThreadPool::currentQueue() const {
+    if (current_pool == this) {
+        return current_queue;
+    }
+
+    return NOT_A_WORKER;
+}
+
+void ThreadPool::submit(Task task) {
+    size_t queue_index = currentQueue();
+
+    if (queue_index == NOT_A_WORKER) {
+        queue_index = _next_queue.fetch_add(1, std::memory_order_relaxed) % _queues.size();
+    }
+
+    {
+        auto& queue = *_queues[queue_index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+
+    {
+        // taking the lock so that a worker cannot miss
+        // the notification between checking and sleeping
+        std::lock_guard<std::mutex> lock(_sleep_mutex);
+        _pending_tasks.fetch_add(1, std::memory_order_release);
+    }
+
+    _task_submitted.notify_one();
+}
+
+bool ThreadPool::tryRunTask(size_t queue_index) {
+    Task task;
+
+    if (queue_index != NOT_A_WORKER) {
+        // own tasks are taken from the back,
+        // they are likely to be hot in cache
+        auto& queue = *_queues[queue_index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+
+        if (!queue.tasks.empty()) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        }
+    }
+
+    if (!task) {
+        size_t start = queue_index == NOT_A_WORKER ? 0 : queue_index + 1;
+
+        for (size_t i = 0; i < _queues.size() && !task; i++) {
+            // stealing the oldest task from the others
+            auto& queue = *_queues[(start + i) % _queues.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+
+            if (!queue.tasks.empty()) {
+                task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+            }
+        }
+    }
+
+    if (!task) {
+        return false;
+    }
+
+    _pending_tasks.fetch_sub(1, std::memory_order_acq_rel);
+    task();
+    return true;
+}
+
+void ThreadPool::work(size_t queue_index) {
+    current_pool = this;
+    current_queue = queue_index;
+
+    while (true) {
+        if (tryRunTask(queue_index)) {
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(_sleep_mutex);
+        _task_submitted.wait(lock, [this]() {
+            return _is_stopped || _pending_tasks.load(std::memory_order_acquire) > 0;
+        });
+
+        if (_is_stopped) {
+            return;
+        }
+    }
+}
+
+void ThreadPool::parallelFor(size_t size, const std::function<void(size_t index)>& body) {
+    if (size == 0) {
+        return;
+    }
+
+    struct Batch {
+    public:
+        std::atomic<size_t> remaining;
+        std::mutex mutex;
+        std::condition_variable finished;
+        std::exception_ptr error;
+    };
+
+    auto batch = std::make_shared<Batch>();
+    batch->remaining = size;
+
+    // the caller runs the first index itself
+    for (size_t i = 1; i < size; i++) {
+        submit([batch, &body, i]() {
+            try {
+                body(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(batch->mutex);
+                if (!batch->error) {
+                    batch->error = std::current_exception();
+                }
+            }
+
+            if (batch->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                std::lock_guard<std::mutex> lock(batch->mutex);
+                batch->finished.notify_all();
+            }
+        });
+    }
+
+    try {
+        body(0);
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(batch->mutex);
+        if (!batch->error) {
+            batch->error = std::current_exception();
+        }
+    }
+    batch->remaining.fetch_sub(1, std::memory_order_acq_rel);
+
+    size_t queue_index = currentQueue();
+    while (batch->remaining.load(std::memory_order_acquire) > 0) {
+        // helping instead of sleeping, the tasks we wait
+        // for might be queued behind the current one
+        if (tryRunTask(queue_index)) {
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(batch->mutex);
+        batch->finished.wait(lock, [&batch]() {
+            return batch->remaining.load(std::memory_order_acquire) == 0;
+        });
+    }
+
+    if (batch->error) {
+        std::rethrow_exception(batch->error);
+    }
+}
+
+} // namespace detection
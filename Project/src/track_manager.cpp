@@ -0,0 +1,173 @@
+#include "track_manager.h"
+
+#include <limits>
+#include <unordered_set>
+
+namespace detection {
+
+TrackManager::Parameters::Parameters(uint32_t reverify_interval,
+                                     double evidence_decay,
+                                     uint32_t min_observations,
+                                     double min_share):
+    reverify_interval(reverify_interval),
+    evidence_decay(evidence_decay),
+    min_observations(min_observations),
+    min_share(min_share) {
+    // empty on purpose
+}
+
+TrackManager::Parameters::Parameters(const Parameters& that):
+    reverify_interval(that.reverify_interval),
+    evidence_decay(that.evidence_decay),
+    min_observations(that.min_observations),
+    min_share(that.min_share) {
+    // empty on purpose
+}
+
+TrackManager::Parameters& TrackManager::Parameters::operator=(const Parameters& that) {
+    if (this != &that) {
+        this->reverify_interval = that.reverify_interval;
+        this->evidence_decay = that.evidence_decay;
+        this->min_observations = that.min_observations;
+        this->min_share = that.min_share;
+    }
+
+    return *this;
+}
+
+TrackManager::Track::Track():
+    votes(),
+    votes_weight(0),
+    scores_sum(0),
+    scores_weight(0),
+    observations(0),
+    verified_frame(0) {
+    // empty on purpose
+}
+
+TrackManager::TrackManager(const Parameters& parameters):
+    _parameters(parameters),
+    _tracks(),
+    _stats({ 0, 0 }) {
+    // empty on purpose
+}
+
+TrackManager::TrackManager(const TrackManager& that):
+    _parameters(that._parameters),
+    _tracks(that._tracks),
+    _stats(that._stats) {
+    // empty on purpose
+}
+
+TrackManager& TrackManager::operator=(const TrackManager& that) {
+    if (this != &that) {
+        this->_parameters = that._parameters;
+        this->_tracks = that._tracks;
+        this->_stats = that._stats;
+    }
+
+    return *this;
+}
+
+std::vector<size_t> TrackManager::select(uint32_t frame_id,
+                                         const std::vector<uint64_t>& track_ids) {
+    std::unordered_set<uint64_t> active_tracks(track_ids.begin(), track_ids.end());
+
+    for (auto it = _tracks.begin(); it != _tracks.end();) {
+        if (active_tracks.count(it->first) == 0) {
+            it = _tracks.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    std::vector<size_t> faces_to_recognise;
+
+    for (size_t i = 0; i < track_ids.size(); i++) {
+        auto it = _tracks.find(track_ids[i]);
+
+        bool is_fresh = it != _tracks.end()
+                && decide(it->second).is_stable
+                && frame_id - it->second.verified_frame < _parameters.reverify_interval;
+
+        if (!is_fresh) {
+            faces_to_recognise.push_back(i);
+        }
+    }
+
+    _stats.recognised += faces_to_recognise.size();
+    _stats.reused += track_ids.size() - faces_to_recognise.size();
+
+    return faces_to_recognise;
+}
+
+void TrackManager::observe(uint64_t track_id,
+                           uint32_t frame_id,
+                           const RecognitionEvidence& evidence) {
+    Track& track = _tracks[track_id];
+    const double decay = _parameters.evidence_decay;
+
+    for (auto& vote: track.votes) {
+        vote.second *= decay;
+    }
+    track.votes_weight *= decay;
+
+    for (const auto& vote: evidence.votes) {
+        track.votes[vote.first] += vote.second;
+        track.votes_weight += vote.second;
+    }
+
+    // NaN scores stay NaN, models that cannot
+    // estimate confidence never get a score
+    track.scores_sum = track.scores_sum * decay + evidence.score;
+    track.scores_weight = track.scores_weight * decay + 1;
+
+    track.observations += 1;
+    track.verified_frame = frame_id;
+}
+
+TrackManager::Decision TrackManager::decide(uint64_t track_id) const {
+    auto it = _tracks.find(track_id);
+
+    if (it == _tracks.end()) {
+        return { FaceRecognitionModel::LABEL_UNKNOWN, std::numeric_limits<double>::quiet_NaN(), 0, false };
+    }
+
+    return decide(it->second);
+}
+
+TrackManager::Decision TrackManager::decide(const Track& track) const {
+    Decision decision = { FaceRecognitionModel::LABEL_UNKNOWN, std::numeric_limits<double>::quiet_NaN(), 0, false };
+
+    double max_votes = 0;
+    for (const auto& vote: track.votes) {
+        if (vote.second > max_votes) {
+            decision.label = vote.first;
+            max_votes = vote.second;
+        }
+    }
+
+    if (track.votes_weight > 0) {
+        decision.share = max_votes / track.votes_weight;
+    }
+
+    if (track.scores_weight > 0) {
+        decision.score = track.scores_sum / track.scores_weight;
+    }
+
+    decision.is_stable = decision.label != FaceRecognitionModel::LABEL_UNKNOWN
+            && track.observations >= _parameters.min_observations
+            && decision.share >= _parameters.min_share;
+
+    return decision;
+}
+
+void TrackManager::reset() {
+    _tracks.clear();
+}
+
+TrackManager::Stats TrackManager::stats() const {
+    return _stats;
+}
+
+} // namespace detection
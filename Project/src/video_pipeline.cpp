@@ -0,0 +1,322 @@
+#include "video_pipeline.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+
+#include "mat_arena.h"
+
+namespace {
+
+double MillisecondsSince(const std::chrono::steady_clock::time_point& start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+namespace detection {
+
+PipelineFrame::PipelineFrame():
+    id(0),
+    image(),
+    is_scene_cut(false),
+    is_keyframe(false),
+    faces(),
+    faces_origins(),
+    track_ids(),
+    labels_ids(),
+    scores() {
+    // empty on purpose
+}
+
+void PipelineFrame::clear() {
+    id = 0;
+    is_scene_cut = false;
+    is_keyframe = false;
+    faces.clear();
+    faces_origins.clear();
+    track_ids.clear();
+    labels_ids.clear();
+    scores.clear();
+
+    // somebody still refers to the pixels,
+    // decoding into them would change that image
+    if (MatArena::IsShared(image)) {
+        image.release();
+    }
+}
+
+VideoPipeline::VideoPipeline(VideoPlayer& video_player,
+                             FaceDetectionModel& face_detection,
+                             FaceTrackingModel& face_tracking,
+                             const FaceRecognitionModel& recognizer,
+                             TrackManager& track_manager,
+                             KeyframeScheduler& keyframe_scheduler,
+                             SceneCutDetector& scene_cut_detector,
+                             uint32_t full_scan_interval,
+                             size_t queue_capacity):
+    _video_player(video_player),
+    _face_detection(face_detection),
+    _face_tracking(face_tracking),
+    _recognizer(recognizer),
+    _track_manager(track_manager),
+    _keyframe_scheduler(keyframe_scheduler),
+    _scene_cut_detector(scene_cut_detector),
+    _full_scan_interval(full_scan_interval),
+    _queue_capacity(queue_capacity),
+    _stats({ 0, 0 }),
+    _error_mutex(),
+    _error() {
+    if (full_scan_interval == 0) {
+        throw std::runtime_error("Full scan interval should be positive.");
+    }
+}
+
+void VideoPipeline::fail(std::exception_ptr error) {
+    std::lock_guard<std::mutex> lock(_error_mutex);
+
+    // only the first error is interesting,
+    // the others are likely to be its consequences
+    if (!_error) {
+        _error = error;
+    }
+}
+
+void VideoPipeline::decode(SpscQueue<FramePtr>& recycled,
+                           SpscQueue<FramePtr>& output) {
+    while (_video_player.hasNextFrame()) {
+        FramePtr frame;
+
+        // frames are only created until the first
+        // ones come back from the sink
+        if (!recycled.tryPop(frame)) {
+            frame = std::make_unique<PipelineFrame>();
+        }
+
+        frame->id = _video_player.currentFrame();
+
+        // the image is either empty or has left the pipeline,
+        // so the player never reuses memory of frames that are
+        // still in flight, keyframes are picked by the localiser
+        _video_player.nextFrame(frame->image);
+
+        if (!output.push(std::move(frame))) {
+            return;
+        }
+    }
+}
+
+void VideoPipeline::detectSceneCuts(SpscQueue<FramePtr>& input,
+                                    SpscQueue<FramePtr>& output) {
+    FramePtr frame;
+
+    while (input.pop(frame)) {
+        frame->is_scene_cut = _scene_cut_detector.isCut(frame->image);
+
+        if (!output.push(std::move(frame))) {
+            return;
+        }
+    }
+}
+
+std::vector<Face> VideoPipeline::detect(PipelineFrame& frame,
+                                        const std::vector<Rect>& tracked_origins,
+                                        uint32_t& keyframes_since_full_scan,
+                                        bool& out_is_full_scan) {
+    Rect viewport(0, 0, frame.image.cols, frame.image.rows);
+
+    keyframes_since_full_scan += 1;
+
+    bool has_lost_faces = std::any_of(tracked_origins.begin(), tracked_origins.end(), [](const Rect& origin) {
+        return origin.empty();
+    });
+
+    // new faces can appear anywhere, so without reliable tracks
+    // the search around them would miss faces
+    bool needs_full_scan = frame.is_scene_cut
+                           || tracked_origins.empty()
+                           || has_lost_faces
+                           || keyframes_since_full_scan >= _full_scan_interval;
+
+    out_is_full_scan = needs_full_scan;
+
+    if (needs_full_scan) {
+        keyframes_since_full_scan = 0;
+        _stats.full_scans += 1;
+        return _face_detection.extractFaces(viewport, frame.image);
+    }
+
+    _stats.roi_scans += 1;
+    return _face_detection.extractFaces(viewport, frame.image, tracked_origins);
+}
+
+void VideoPipeline::localise(SpscQueue<FramePtr>& input,
+                             SpscQueue<FramePtr>& output) {
+    FramePtr frame;
+
+    // faces of the previous frame, the tracker keeps
+    // them close to the faces of the next keyframe
+    std::vector<Rect> tracked_origins;
+    uint32_t keyframes_since_full_scan = 0;
+
+    while (input.pop(frame)) {
+        // a cut always makes a keyframe, so trackers
+        // never follow faces of the previous shot
+        frame->is_keyframe = _keyframe_scheduler.isKeyframe(frame->is_scene_cut);
+
+        if (frame->is_scene_cut) {
+            _face_tracking.dropTracks();
+        }
+
+        auto start = std::chrono::steady_clock::now();
+
+        if (frame->is_keyframe) {
+            bool is_full_scan = true;
+            frame->faces = detect(*frame, tracked_origins, keyframes_since_full_scan, is_full_scan);
+
+            for (const auto& face: frame->faces) {
+                frame->faces_origins.push_back(face.origin);
+            }
+
+            _face_tracking.resetTracking(frame->image, frame->faces_origins);
+            // scans around tracked faces can only find them again,
+            // so they never let the scheduler back off
+            _keyframe_scheduler.onDetected(frame->faces.size(), MillisecondsSince(start), is_full_scan);
+        } else {
+            std::vector<double> confidences;
+            _face_tracking.track(frame->image, frame->faces_origins, confidences);
+            _keyframe_scheduler.onTracked(confidences, MillisecondsSince(start));
+        }
+
+        frame->track_ids = _face_tracking.trackIds();
+        tracked_origins = frame->faces_origins;
+
+        if (!output.push(std::move(frame))) {
+            return;
+        }
+    }
+}
+
+void VideoPipeline::recognise(SpscQueue<FramePtr>& input,
+                              SpscQueue<FramePtr>& output) {
+    FramePtr frame;
+
+    std::vector<int> group_labels_ids;
+    std::vector<double> group_scores;
+
+    while (input.pop(frame)) {
+        if (frame->is_keyframe) {
+            if (frame->is_scene_cut) {
+                _track_manager.reset();
+            }
+
+            std::vector<size_t> faces_to_recognise = _track_manager.select(frame->id, frame->track_ids);
+
+            if (!faces_to_recognise.empty()) {
+                std::vector<cv::Mat> faces_images;
+                for (const auto& face_index: faces_to_recognise) {
+                    faces_images.push_back(frame->faces[face_index].image);
+                }
+
+                std::vector<RecognitionEvidence> evidence = _recognizer.predictEvidence(faces_images);
+
+                for (size_t i = 0; i < faces_to_recognise.size(); i++) {
+                    _track_manager.observe(frame->track_ids[faces_to_recognise[i]], frame->id, evidence[i]);
+                }
+            }
+
+            group_labels_ids.clear();
+            group_scores.clear();
+
+            for (const auto& track_id: frame->track_ids) {
+                const auto& decision = _track_manager.decide(track_id);
+                group_labels_ids.push_back(decision.label);
+                group_scores.push_back(decision.score);
+            }
+        }
+
+        frame->labels_ids = group_labels_ids;
+        frame->scores = group_scores;
+
+        if (!output.push(std::move(frame))) {
+            return;
+        }
+    }
+}
+
+void VideoPipeline::run(const Sink& sink) {
+    _error = nullptr;
+
+    SpscQueue<FramePtr> decoded_frames(_queue_capacity);
+    SpscQueue<FramePtr> cut_frames(_queue_capacity);
+    SpscQueue<FramePtr> localised_frames(_queue_capacity);
+    SpscQueue<FramePtr> recognised_frames(_queue_capacity);
+
+    std::vector<SpscQueue<FramePtr>*> queues = { &decoded_frames, &cut_frames, &localised_frames, &recognised_frames };
+
+    // enough for every frame in flight, frames that
+    // do not fit are simply freed
+    SpscQueue<FramePtr> recycled_frames(queues.size() * (_queue_capacity + 1));
+
+    // every stage closes its output when it is over,
+    // if a stage fails all the queues are closed to stop
+    // the rest of the pipeline as soon as possible
+    auto run_stage = [this, &queues](SpscQueue<FramePtr>& output, const std::function<void()>& stage) {
+        try {
+            stage();
+        } catch (...) {
+            fail(std::current_exception());
+
+            for (auto* queue: queues) {
+                queue->close();
+            }
+        }
+
+        output.close();
+    };
+
+    std::thread decoder([&]() {
+        run_stage(decoded_frames, [&]() { decode(recycled_frames, decoded_frames); });
+    });
+    std::thread scene_cuts_detector([&]() {
+        run_stage(cut_frames, [&]() { detectSceneCuts(decoded_frames, cut_frames); });
+    });
+    std::thread localiser([&]() {
+        run_stage(localised_frames, [&]() { localise(cut_frames, localised_frames); });
+    });
+    std::thread recogniser([&]() {
+        run_stage(recognised_frames, [&]() { recognise(localised_frames, recognised_frames); });
+    });
+
+    try {
+        FramePtr frame;
+        while (recognised_frames.pop(frame)) {
+            sink(*frame);
+
+            frame->clear();
+            recycled_frames.tryPush(frame);
+        }
+    } catch (...) {
+        fail(std::current_exception());
+    }
+
+    for (auto* queue: queues) {
+        queue->close();
+    }
+
+    decoder.join();
+    scene_cuts_detector.join();
+    localiser.join();
+    recogniser.join();
+
+    if (_error) {
+        std::rethrow_exception(_error);
+    }
+}
+
+VideoPipeline::Stats VideoPipeline::stats() const {
+    return _stats;
+}
+
+} // namespace detection
@@ -2,40 +2,132 @@
 
 namespace detection {
 
-VideoPlayer::VideoPlayer(const std::string& video_file,
-                         uint32_t playback_group_size):
-    _video_file(video_file),
-    _video_capture(video_file),
-    _playback_group_size(playback_group_size),
-    _current_frame(0) {
+VideoPlayer::Stats::Stats():
+    consumer_stalls(0),
+    decoder_stalls(0),
+    decoded_frames(0) {
     // empty on purpose
 }
 
-VideoPlayer::VideoPlayer(const VideoPlayer& that):
-        _video_file(that._video_file),
-        _video_capture(that._video_capture),
-        _playback_group_size(that._playback_group_size),
-        _current_frame(that._current_frame) {
+VideoPlayer::Stats::Stats(const Stats& that):
+    consumer_stalls(that.consumer_stalls),
+    decoder_stalls(that.decoder_stalls),
+    decoded_frames(that.decoded_frames) {
     // empty on purpose
 }
 
-VideoPlayer& VideoPlayer::operator=(const VideoPlayer& that) {
+VideoPlayer::Stats& VideoPlayer::Stats::operator=(const Stats& that) {
     if (this != &that) {
-        this->_video_file = that._video_file;
-        this->_video_capture = that._video_capture;
-        this->_playback_group_size = that._playback_group_size;
-        this->_current_frame = that._current_frame;
+        this->consumer_stalls = that.consumer_stalls;
+        this->decoder_stalls = that.decoder_stalls;
+        this->decoded_frames = that.decoded_frames;
     }
 
     return *this;
 }
 
+VideoPlayer::VideoPlayer(const std::string& video_file,
+                         uint32_t playback_group_size,
+                         uint32_t prefetch_depth):
+    _video_file(video_file),
+    _video_capture(video_file),
+    _is_opened(false),
+    _frames_count(0),
+    _current_frame(0),
+    _playback_group_size(playback_group_size),
+    _prefetch_depth(prefetch_depth),
+    _ring(prefetch_depth),
+    _ring_head(0),
+    _ring_size(0),
+    _is_decoding_finished(false),
+    _is_stopped(false),
+    _stats(),
+    _ring_mutex(),
+    _frame_decoded(),
+    _buffer_released(),
+    _decoder() {
+    _is_opened = _video_capture.isOpened();
+    _frames_count = static_cast<size_t>(_video_capture.get(cv::CAP_PROP_FRAME_COUNT));
+
+    if (_prefetch_depth > 0) {
+        if (_is_opened) {
+            _decoder = std::thread(&VideoPlayer::decodeAhead, this);
+        } else {
+            // there is nothing to decode
+            _is_decoding_finished = true;
+        }
+    }
+}
+
+VideoPlayer::~VideoPlayer() {
+    {
+        std::lock_guard<std::mutex> lock(_ring_mutex);
+        _is_stopped = true;
+    }
+
+    _buffer_released.notify_all();
+
+    if (_decoder.joinable()) {
+        _decoder.join();
+    }
+}
+
+void VideoPlayer::decodeAhead() {
+    // the buffer that is being decoded into
+    // never leaves the decoder thread, so the capture
+    // can be read without holding the lock
+    cv::Mat buffer;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(_ring_mutex);
+
+            if (_ring_size == _prefetch_depth && !_is_stopped) {
+                _stats.decoder_stalls += 1;
+                _buffer_released.wait(lock, [this]() {
+                    return _ring_size < _prefetch_depth || _is_stopped;
+                });
+            }
+
+            if (_is_stopped) {
+                return;
+            }
+
+            // taking the memory of the free slot
+            // to decode the next frame into it
+            size_t tail = (_ring_head + _ring_size) % _prefetch_depth;
+            cv::swap(buffer, _ring[tail]);
+        }
+
+        bool is_decoded = _video_capture.read(buffer);
+
+        {
+            std::lock_guard<std::mutex> lock(_ring_mutex);
+
+            if (!is_decoded) {
+                _is_decoding_finished = true;
+            } else {
+                size_t tail = (_ring_head + _ring_size) % _prefetch_depth;
+                cv::swap(buffer, _ring[tail]);
+                _ring_size += 1;
+                _stats.decoded_frames += 1;
+            }
+        }
+
+        _frame_decoded.notify_one();
+
+        if (!is_decoded) {
+            return;
+        }
+    }
+}
+
 bool VideoPlayer::isOpened() const {
-    return _video_capture.isOpened();
+    return _is_opened;
 }
 
 size_t VideoPlayer::framesCount() const {
-    return static_cast<size_t>(_video_capture.get(cv::CAP_PROP_FRAME_COUNT));
+    return _frames_count;
 }
 
 uint32_t VideoPlayer::currentFrame() const {
@@ -44,11 +136,39 @@ uint32_t VideoPlayer::currentFrame() const {
 
 bool VideoPlayer::hasNextFrame() const {
     bool has_frame_to_advance_further = (_current_frame + 1) < framesCount();
-    return _video_capture.isOpened() && has_frame_to_advance_further;
+    return _is_opened && has_frame_to_advance_further;
 }
 
 VideoPlayer::PlaybackGroupState VideoPlayer::nextFrame(cv::Mat& frame) {
-    _video_capture >> frame;
+    if (_prefetch_depth == 0) {
+        _video_capture >> frame;
+    } else {
+        {
+            std::unique_lock<std::mutex> lock(_ring_mutex);
+
+            if (_ring_size == 0 && !_is_decoding_finished) {
+                _stats.consumer_stalls += 1;
+                _frame_decoded.wait(lock, [this]() {
+                    return _ring_size > 0 || _is_decoding_finished;
+                });
+            }
+
+            if (_ring_size > 0) {
+                // giving the previous frame's memory
+                // back to the decoder
+                cv::swap(frame, _ring[_ring_head]);
+                _ring_head = (_ring_head + 1) % _prefetch_depth;
+                _ring_size -= 1;
+            } else {
+                // the same behaviour as the capture has
+                // when the video is over
+                frame.release();
+            }
+        }
+
+        _buffer_released.notify_one();
+    }
+
     uint32_t position_within_playback_group = _current_frame % _playback_group_size;
     // advancing our player
     _current_frame += 1;
@@ -61,4 +181,9 @@ VideoPlayer::PlaybackGroupState VideoPlayer::nextFrame(cv::Mat& frame) {
     return PlaybackGroupState::PLAYING_EXISTING_GROUP;
 }
 
+VideoPlayer::Stats VideoPlayer::stats() const {
+    std::lock_guard<std::mutex> lock(_ring_mutex);
+    return _stats;
+}
+
 } // namespace detection